@@ -24,6 +24,7 @@
  *---------------------------------------------------------------------------*/
  
 #include "cmsis_os.h"
+#include "LPC17xx.h"
  
 
 /*----------------------------------------------------------------------------
@@ -39,7 +40,7 @@
 //   <i> Defines max. number of user threads that will run at the same time.
 //   <i> Default: 6
 #ifndef OS_TASKCNT
- #define OS_TASKCNT     12
+ #define OS_TASKCNT     14
 #endif
  
 //   <o>Default Thread stack size [bytes] <64-4096:8><#/4>
@@ -163,14 +164,14 @@
 //   <i> Defines stack size for Timer thread.
 //   <i> Default: 200
 #ifndef OS_TIMERSTKSZ
- #define OS_TIMERSTKSZ  50     // this stack size value is in words
+ #define OS_TIMERSTKSZ  64     // this stack size value is in words, callbacks need up to 32
 #endif
  
 //   <o>Timer Callback Queue size <1-32>
 //   <i> Number of concurrent active timer callback functions.
 //   <i> Default: 4
 #ifndef OS_TIMERCBQS
- #define OS_TIMERCBQS   4
+ #define OS_TIMERCBQS   8      // Joystick_Timer is due every 5 ms, Uptime_Timer every 1 s
 #endif
  
 // </e>
@@ -212,11 +213,22 @@
  
 /*--------------------------- os_idle_demon ---------------------------------*/
 
+/// Cycles spent in the idle demon, read by main.c for the CPU load figure.
+/// A gap longer than IDLE_GAP_CYCLES between two loop passes means another
+/// thread or an interrupt ran in between, so it is not counted as idle.
+#define IDLE_GAP_CYCLES 200
+volatile uint32_t os_idle_cycles;
+
 /// \brief The idle demon is running when no other thread is ready to run
 void os_idle_demon (void) {
+  uint32_t last = DWT->CYCCNT, now;
  
   for (;;) {
-    /* HERE: include optional user code to be executed when no thread runs.*/
+    now = DWT->CYCCNT;
+    if (now - last < IDLE_GAP_CYCLES) {
+      os_idle_cycles += now - last;
+    }
+    last = now;
   }
 }
  
@@ -266,6 +278,7 @@ void os_tick_irqack (void) {
 #define OS_ERROR_TIMER_OVF      4
  
 extern osThreadId svcThreadGetId (void);
+extern void crash_error (uint32_t error_code);
  
 /// \brief Called when a runtime error is detected
 /// \param[in]   error_code   actual error code that has been detected
@@ -289,6 +302,7 @@ void os_error (uint32_t error_code) {
     default:
       break;
   }
+  crash_error(error_code);   /* Records the failing thread and resets, see crash.h */
   for (;;);
 }
  
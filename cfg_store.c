@@ -0,0 +1,116 @@
+#include <stddef.h>
+#include <string.h>
+#include "flash_iap.h"
+#include "cfg_store.h"
+
+#define CFG_SECTOR 28                    // First of the two sectors
+#define CFG_BASE 0x00070000
+#define CFG_SECTOR_SIZE 0x8000
+#define CFG_MAGIC 0x43464731             // "CFG1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;                        // Counts every save ever made
+    uint16_t version;                    // Caller's layout version
+    uint16_t len;                        // Payload bytes used
+    uint8_t data[CFG_DATA_MAX];
+    uint32_t crc;                        // CRC-32 of everything above
+} CfgRecord;
+
+static CfgRecord record;                 // Copy source, IAP wants it word aligned in RAM
+static const CfgRecord *newest;          // NULL while the store is empty
+static int active = -1;                  // Sector holding newest, -1 when empty
+static int next_slot;                    // First unwritten record in the active sector
+
+static const CfgRecord *slot(int sector, int n) {
+    return (const CfgRecord *)(uintptr_t)(CFG_BASE + sector * CFG_SECTOR_SIZE) + n;
+}
+
+static uint32_t crc32(const void *data, int len) {
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFF;
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static int record_ok(const CfgRecord *r) {
+    return r->magic == CFG_MAGIC && r->len <= CFG_DATA_MAX &&
+           r->crc == crc32(r, offsetof(CfgRecord, crc));
+}
+
+static int program(int sector, int n) {
+    if (flash_program((uint32_t)(uintptr_t)slot(sector, n), &record, sizeof(record)) != 0) return -1;
+    return record_ok(slot(sector, n)) ? 0 : -1;
+}
+
+// Records are written in order, so the used part of a sector is a prefix and
+// a binary search finds its end in log2(CFG_RECORDS) reads. The newest good
+// record is then the last one whose CRC holds; a torn write leaves at most
+// one bad record at the end.
+int cfg_store_init(void) {
+    int lo, hi;
+
+    newest = NULL;
+    active = -1;
+    next_slot = 0;
+    for (int s = 0; s < 2; s++) {
+        if (record_ok(slot(s, 0)) && (active < 0 || slot(s, 0)->seq > slot(active, 0)->seq)) active = s;
+    }
+    if (active < 0) return -1;
+
+    lo = 0;
+    hi = CFG_RECORDS - 1;
+    while (lo < hi) { // Last slot with the magic written
+        int mid = (lo + hi + 1) / 2;
+        if (slot(active, mid)->magic != 0xFFFFFFFF) lo = mid; else hi = mid - 1;
+    }
+    next_slot = lo + 1;
+    while (!record_ok(slot(active, lo))) lo--; // Stops at slot 0, checked above
+    newest = slot(active, lo);
+    return 0;
+}
+
+int cfg_store_load(void *data, int max, uint16_t version) {
+    int len;
+    if (!newest || newest->version != version) return 0;
+    len = newest->len < max ? newest->len : max;
+    memcpy(data, newest->data, len);
+    return len;
+}
+
+int cfg_store_save(const void *data, int len, uint16_t version) {
+    int sector = active < 0 ? 0 : active;
+    int n = next_slot;
+
+    if (len > CFG_DATA_MAX) return -1;
+    if (newest && newest->version == version && newest->len == len &&
+        memcmp(newest->data, data, len) == 0) return 1; // Nothing to wear the flash for
+
+    if (active < 0 || n >= CFG_RECORDS) {
+        // Erase the sector not holding the newest record, which stays
+        // readable until the new one is complete
+        sector = active < 0 ? 0 : 1 - active;
+        n = 0;
+        if (flash_erase(CFG_SECTOR + sector) != 0) return -1;
+    }
+
+    memset(&record, 0xFF, sizeof(record));
+    record.magic = CFG_MAGIC;
+    record.seq = newest ? newest->seq + 1 : 1;
+    record.version = version;
+    record.len = len;
+    memcpy(record.data, data, len);
+    record.crc = crc32(&record, offsetof(CfgRecord, crc));
+    if (program(sector, n) != 0) {
+        if (sector == active) next_slot = n + 1; // Never program a slot twice
+        return -1;
+    }
+
+    newest = slot(sector, n);
+    active = sector;
+    next_slot = n + 1;
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef CFG_STORE_H
+#define CFG_STORE_H
+
+#include <stdint.h>
+
+// Settings record store in the two top 32 kB flash sectors (28 and 29, from
+// 0x70000), which the project's IROM region leaves out of the image. Each
+// save appends one 256-byte record, the smallest IAP write, holding the
+// caller's data, a version, a sequence number and a CRC-32. A sector is only
+// erased when the other one is full, so each sector sees one erase per
+// 2 * CFG_RECORDS saves, and the newest good record survives a reset in the
+// middle of a save. Writes go through flash_iap, with interrupts disabled.
+
+#define CFG_DATA_MAX 240        // Payload bytes per record
+#define CFG_RECORDS 128         // Records per sector
+
+int cfg_store_init(void);       // Locates the newest record, -1 if there is none. Call first
+int cfg_store_load(void *data, int max, uint16_t version); // Bytes copied, 0 if none or another version
+int cfg_store_save(const void *data, int len, uint16_t version); // 0 once written, 1 if unchanged, -1 on failure
+
+#endif
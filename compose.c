@@ -0,0 +1,51 @@
+#include <stddef.h>
+#include "glcd_dma.h"
+#include "compose.h"
+
+#define PANEL_W 320
+
+static uint16_t bands[2][PANEL_W * COMPOSE_LINES]
+    __attribute__((section(".bss.ARM.__at_0x20080000")));
+static const GLCD_FONT *compose_font;
+static int next_band;               // Buffer to build next, the other may still be on the bus
+
+void compose_init(const GLCD_FONT *font) {
+    compose_font = font;
+}
+
+// One scanline of a span; line counts from the top of the text
+static void render_span(uint16_t *row, const ComposeSpan *s, int line) {
+    int wb = (compose_font->width + 7) / 8;
+    uint16_t fg = s->fg, bg = s->bg;
+    const char *text = s->text;
+    int x = s->x, end = s->x + s->w;
+
+    if (end > PANEL_W) end = PANEL_W;
+    if (text != NULL && line < compose_font->height) {
+        for (; *text && x < end; text++) {
+            const uint8_t *bits = compose_font->bitmap
+                + ((uint32_t)(*text - compose_font->offset) * compose_font->height + line) * wb;
+            for (int i = 0; i < compose_font->width && x < end; i++, x++) {
+                row[x] = (bits[i >> 3] >> (i & 7)) & 1 ? fg : bg;
+            }
+        }
+    }
+    for (; x < end; x++) row[x] = bg;
+}
+
+void compose_region(int y, int h, uint32_t bg, const ComposeSpan *spans, int count) {
+    if (compose_font == NULL) return;
+    for (int top = 0; top < h; top += COMPOSE_LINES, next_band ^= 1) {
+        int lines = h - top < COMPOSE_LINES ? h - top : COMPOSE_LINES;
+        uint16_t *buf = bands[next_band];
+
+        // Buffers alternate and a blit waits for the one before it, so
+        // this buffer is no longer being read by the time it is rebuilt
+        for (int l = 0; l < lines; l++) {
+            uint16_t *row = buf + l * PANEL_W;
+            for (int x = 0; x < PANEL_W; x++) row[x] = (uint16_t)bg;
+            for (int i = 0; i < count; i++) render_span(row, &spans[i], top + l);
+        }
+        glcd_dma_blit(0, y + top, PANEL_W, lines, buf);
+    }
+}
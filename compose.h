@@ -0,0 +1,30 @@
+#ifndef COMPOSE_H
+#define COMPOSE_H
+
+#include <stdint.h>
+#include "Board_GLCD.h"
+
+// Band compositor for the GLCD. A screen region is described as spans of
+// text or plain colour; it is rendered COMPOSE_LINES scanlines at a time
+// into a band buffer and every band goes to the panel once, so a partial
+// update writes each pixel a single time and nothing flickers. Two band
+// buffers alternate: one is being sent by GPDMA while the next is built.
+//
+// The buffers live in AHB SRAM bank 1, the glyph cache uses bank 0.
+
+#define COMPOSE_LINES 12            // 2 * 320 * 12 * 2 = 15 kB of the 16 kB bank
+
+typedef struct {
+    int x, w;                       // Horizontal extent in pixels
+    const char *text;               // Drawn from the span's left edge, NULL for a plain fill
+    uint32_t fg, bg;                // Colours as for GLCD_SetForegroundColor()
+} ComposeSpan;
+
+void compose_init(const GLCD_FONT *font);
+
+// Renders rows y .. y + h - 1 across the full panel width and queues them.
+// Pixels outside every span take bg. Spans are drawn in order, a later span
+// covers an earlier one. Text lines up with the top of the region.
+void compose_region(int y, int h, uint32_t bg, const ComposeSpan *spans, int count);
+
+#endif
@@ -0,0 +1,158 @@
+#include <LPC17xx.h>
+#include <stddef.h>
+#include "flash_iap.h"
+#include "crash.h"
+
+#define CRASH_RAM 0x10007A00             // Below the boot ROM stack and IAP scratch at the top
+#define CRASH_SECTOR 22                  // First of the two
+#define CRASH_BASE 0x00040000
+#define CRASH_SECTOR_BYTES 0x8000
+#define CRASH_MAGIC 0x43525348           // "CRSH"
+#define TRACE_MAGIC 0x54524345           // "TRCE"
+
+static CrashRecord *const record = (CrashRecord *)CRASH_RAM;
+
+// Start of the RTX 4 kernel's struct OS_TSK. The running thread's TCB is its
+// osThreadId, with the task number in the fourth byte.
+extern struct { uint8_t *run; uint8_t *next; } os_tsk;
+
+static int in_ram(uint32_t addr, uint32_t bytes) {
+    return (addr >= 0x10000000 && addr + bytes <= 0x10008000) ||
+           (addr >= 0x2007C000 && addr + bytes <= 0x20084000);
+}
+
+// Record n of sector 0 or 1 of the two
+static const CrashRecord *slot(int sector, int n) {
+    return (const CrashRecord *)(CRASH_BASE + sector * CRASH_SECTOR_BYTES) + n;
+}
+
+static int used_slots(int sector) {
+    int n = 0;
+    while (n < CRASH_SLOTS && slot(sector, n)->magic == CRASH_MAGIC) n++;
+    return n;
+}
+
+static uint32_t newest_seq(int sector) {
+    int n = used_slots(sector);
+    return n ? slot(sector, n - 1)->seq : 0;
+}
+
+// The sector holding the newest record, the one written to next
+static int active_sector(void) {
+    return newest_seq(1) > newest_seq(0);
+}
+
+void crash_trace(int event, int arg) {
+    uint32_t primask = __get_PRIMASK();
+    uint32_t now = DWT->CYCCNT / (SystemCoreClock / 1000000);
+    TraceEntry *e;
+
+    __disable_irq();
+    e = &record->trace[record->trace_count++ % TRACE_LEN];
+    if (!primask) __enable_irq();
+    e->time_us = now;
+    e->event = event;
+    e->arg = arg;
+}
+
+void crash_init(void) {
+    int s, n;
+
+    if (record->magic == CRASH_MAGIC) {
+        s = active_sector();
+        n = used_slots(s);
+        record->seq = newest_seq(s) + 1;
+        if (n == CRASH_SLOTS) { // Full, move over to the other, older one
+            s ^= 1;
+            n = 0;
+        }
+        if (n == 0) flash_erase(CRASH_SECTOR + s); // Also clears whatever was there before the log
+        flash_program((uint32_t)slot(s, n), record, sizeof(CrashRecord));
+        record->magic = 0;
+    }
+    if (record->trace_magic != TRACE_MAGIC) { // Power-on, the RAM holds noise
+        record->trace_magic = TRACE_MAGIC;
+        record->trace_count = 0;
+    }
+    crash_trace(TRACE_BOOT, LPC_SC->RSID);
+    LPC_SC->RSID = 0x0F; // Clear, so the next boot sees only its own cause
+}
+
+// Fills in everything but the exception frame and resets
+static void capture(uint32_t reason, uint32_t sp) {
+    const uint8_t *tcb = os_tsk.run;
+
+    record->reason = reason;
+    record->msp = __get_MSP();
+    record->psp = __get_PSP();
+    record->cfsr = SCB->CFSR;
+    record->hfsr = SCB->HFSR;
+    record->mmfar = SCB->MMFAR;
+    record->bfar = SCB->BFAR;
+    record->thread = in_ram((uint32_t)tcb, 4) ? (uint32_t)tcb : 0;
+    record->task_id = record->thread ? tcb[3] : 0;
+    for (int i = 0; i < CRASH_STACK_WORDS; i++) {
+        uint32_t addr = sp + i * 4;
+        record->stack[i] = in_ram(addr, 4) ? *(const uint32_t *)addr : 0;
+    }
+    record->magic = CRASH_MAGIC; // Last, the record is complete
+    NVIC_SystemReset();
+}
+
+// Entered from the fault handlers with the stack pointer that holds the
+// exception frame
+void crash_fault(const uint32_t *frame, uint32_t exc_return) {
+    int ok = in_ram((uint32_t)frame, sizeof(record->frame));
+    __disable_irq();
+    for (int i = 0; i < 8; i++) record->frame[i] = ok ? frame[i] : 0;
+    record->exc_return = exc_return;
+    capture(__get_IPSR(), (uint32_t)frame + sizeof(record->frame));
+}
+
+// Called by RTX in handler mode; the failing thread is the one on the PSP
+void crash_error(uint32_t code) {
+    __disable_irq();
+    crash_trace(TRACE_OS_ERROR, code);
+    for (int i = 0; i < 8; i++) record->frame[i] = 0;
+    record->frame[5] = (uint32_t)__builtin_return_address(0);
+    record->exc_return = 0;
+    capture(0x100 + code, __get_PSP());
+}
+
+// Replace the weak handlers of startup_LPC17xx.s. Picks the stack the
+// exception frame went to and passes EXC_RETURN along.
+__attribute__((naked)) void HardFault_Handler(void) {
+    __asm volatile(
+        "tst lr, #4       \n"
+        "ite eq           \n"
+        "mrseq r0, msp    \n"
+        "mrsne r0, psp    \n"
+        "mov r1, lr       \n"
+        "b crash_fault    \n");
+}
+
+__attribute__((naked)) void MemManage_Handler(void) {
+    __asm volatile("b HardFault_Handler\n");
+}
+
+__attribute__((naked)) void BusFault_Handler(void) {
+    __asm volatile("b HardFault_Handler\n");
+}
+
+__attribute__((naked)) void UsageFault_Handler(void) {
+    __asm volatile("b HardFault_Handler\n");
+}
+
+int crash_count(void) {
+    return used_slots(0) + used_slots(1);
+}
+
+const CrashRecord *crash_get(int n) {
+    int s = active_sector(), used = used_slots(s);
+
+    if (n < 0) return NULL;
+    if (n < used) return slot(s, used - 1 - n);
+    n -= used;
+    used = used_slots(s ^ 1);
+    return n < used ? slot(s ^ 1, used - 1 - n) : NULL;
+}
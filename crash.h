@@ -0,0 +1,67 @@
+#ifndef CRASH_H
+#define CRASH_H
+
+#include <stdint.h>
+
+// Crash records. A 1 kB block at the top of IRAM1, which the project's IRAM1
+// region leaves out, holds a ring of recent trace events and, after a
+// HardFault, bus, memory or usage fault or an RTX error such as a stack
+// overflow, the registers, fault status, running thread and the top of its
+// stack. The handler only copies words and resets, with no RTX call and no
+// flash write, so it works however broken the system is. The RAM is not
+// cleared by the reset; crash_init() then commits the record to flash
+// sectors 22 and 23, filled in turn. A full sector is only erased once the
+// other one is full too, so the last CRASH_SLOTS crashes are always kept,
+// and up to twice that many.
+//
+// Trace events are a timestamp in microseconds (DWT cycle counter, restarts
+// at boot), an event code and a 16-bit argument. crash_trace() is safe from
+// threads and interrupts and takes a few cycles.
+
+#define CRASH_SLOTS 32          // Records in each flash sector
+#define CRASH_STACK_WORDS 32
+#define TRACE_LEN 100
+
+enum {
+    TRACE_BOOT = 1,             // arg: reset source, LPC_SC->RSID
+    TRACE_ACTUATOR,             // arg: actuator << 8 | on
+    TRACE_PARAM,                // arg: param_table index
+    TRACE_COMMAND,              // arg: command_table index
+    TRACE_FRAME,                // arg: overrunning frame time in 100 us
+    TRACE_FLASH,                // arg: sector erased or programmed
+    TRACE_OS_ERROR              // arg: RTX error code
+};
+
+// time_us is the 32-bit cycle counter divided down, so it wraps every
+// 2^32 / SystemCoreClock seconds, about 43 s at 100 MHz. The order of the
+// events is their place in the ring; only the gaps between neighbours less
+// than a wrap apart can be read from the timestamps.
+typedef struct {
+    uint32_t time_us;
+    uint16_t event;
+    uint16_t arg;
+} TraceEntry;
+
+typedef struct {
+    uint32_t magic;             // CRASH_MAGIC once a record is complete
+    uint32_t seq;               // Crash number, set when committed to flash
+    uint32_t reason;            // Exception number, or 0x100 + RTX error code
+    uint32_t frame[8];          // r0-r3, r12, lr, pc, xpsr as stacked by the exception
+    uint32_t exc_return, msp, psp;
+    uint32_t cfsr, hfsr, mmfar, bfar;
+    uint32_t thread;            // osThreadId of the running thread, 0 if none
+    uint32_t task_id;           // RTX task number of that thread
+    uint32_t stack[CRASH_STACK_WORDS]; // From the thread's stack pointer up
+    uint32_t trace_magic;
+    uint32_t trace_count;       // Events ever traced, the ring holds the last TRACE_LEN
+    TraceEntry trace[TRACE_LEN];
+    uint32_t pad[2];            // To 1024 bytes, one IAP write
+} CrashRecord;
+
+void crash_init(void);          // First thing in main(): commits a pending record
+void crash_trace(int event, int arg);
+void crash_error(uint32_t code); // From os_error(), does not return
+int crash_count(void);          // Records in flash
+const CrashRecord *crash_get(int n); // n = 0 is the newest, NULL past the oldest
+
+#endif
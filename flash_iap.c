@@ -0,0 +1,43 @@
+#include <LPC17xx.h>
+#include "flash_iap.h"
+#include "crash.h"
+
+// IAP commands (UM10360 chapter 32)
+#define IAP_ENTRY 0x1FFF1FF1
+#define IAP_PREPARE 50
+#define IAP_COPY 51
+#define IAP_ERASE 52
+#define IAP_SUCCESS 0
+
+typedef void (*IapEntry)(uint32_t *command, uint32_t *result);
+
+static uint32_t iap(uint32_t cmd, uint32_t p0, uint32_t p1, uint32_t p2, uint32_t p3) {
+    uint32_t command[5] = { cmd, p0, p1, p2, p3 };
+    uint32_t result[5];
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq(); // Flash is not readable while IAP runs, neither are the vectors
+    ((IapEntry)IAP_ENTRY)(command, result);
+    if (!primask) __enable_irq();
+    return result[0];
+}
+
+uint32_t flash_sector_addr(int sector) {
+    return sector < 16 ? sector * 0x1000 : 0x10000 + (sector - 16) * 0x8000;
+}
+
+int flash_erase(int sector) {
+    uint32_t result;
+    if (iap(IAP_PREPARE, sector, sector, 0, 0) != IAP_SUCCESS) return -1;
+    result = iap(IAP_ERASE, sector, sector, SystemCoreClock / 1000, 0);
+    crash_trace(TRACE_FLASH, sector); // Interrupts were off for the erase
+    return result == IAP_SUCCESS ? 0 : -1;
+}
+
+int flash_program(uint32_t addr, const void *data, int len) {
+    int sector = addr < 0x10000 ? addr / 0x1000 : 16 + (addr - 0x10000) / 0x8000;
+    uint32_t result;
+    if (iap(IAP_PREPARE, sector, sector, 0, 0) != IAP_SUCCESS) return -1;
+    result = iap(IAP_COPY, addr, (uint32_t)data, len, SystemCoreClock / 1000);
+    crash_trace(TRACE_FLASH, sector);
+    return result == IAP_SUCCESS ? 0 : -1;
+}
@@ -0,0 +1,17 @@
+#ifndef FLASH_IAP_H
+#define FLASH_IAP_H
+
+#include <stdint.h>
+
+// On-chip flash programming through the boot ROM IAP calls. The flash cannot
+// be read while it is being programmed, so each call runs with interrupts
+// disabled: about 1 ms per 256-byte page, up to 100 ms per sector erase.
+// Sectors 0-15 are 4 kB, 16-29 are 32 kB.
+
+#define FLASH_PAGE 256          // Smallest write
+
+uint32_t flash_sector_addr(int sector);
+int flash_erase(int sector);    // 0 on success
+int flash_program(uint32_t addr, const void *data, int len); // addr page aligned, len 256/512/1024/4096,
+                                                             // data word aligned in RAM. 0 on success
+#endif
@@ -0,0 +1,78 @@
+#include "fmt.h"
+
+void fmt_init(FmtBuf *f, char *buf, int cap) {
+    f->buf = buf;
+    f->len = 0;
+    f->cap = cap;
+    if (cap > 0) buf[0] = '\0';
+}
+
+void fmt_char(FmtBuf *f, char c) {
+    if (f->len + 1 < f->cap) {
+        f->buf[f->len++] = c;
+        f->buf[f->len] = '\0';
+    }
+}
+
+void fmt_str(FmtBuf *f, const char *str) {
+    while (*str && f->len + 1 < f->cap) {
+        f->buf[f->len++] = *str++;
+    }
+    if (f->cap > 0) f->buf[f->len] = '\0';
+}
+
+void fmt_str_pad(FmtBuf *f, const char *str, int width) {
+    int start = f->len;
+    fmt_str(f, str);
+    while (f->len - start < width && f->len + 1 < f->cap) {
+        f->buf[f->len++] = ' ';
+    }
+    if (f->cap > 0) f->buf[f->len] = '\0';
+}
+
+void fmt_uint_pad(FmtBuf *f, uint32_t value, int width, char pad) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (width-- > n) fmt_char(f, pad);
+    while (n) fmt_char(f, digits[--n]);
+}
+
+void fmt_uint(FmtBuf *f, uint32_t value) {
+    fmt_uint_pad(f, value, 0, ' ');
+}
+
+void fmt_int(FmtBuf *f, int32_t value) {
+    if (value < 0) {
+        fmt_char(f, '-');
+        fmt_uint(f, 0u - (uint32_t)value);
+    } else {
+        fmt_uint(f, value);
+    }
+}
+
+void fmt_hex(FmtBuf *f, uint32_t value, int digits) {
+    static const char hex[] = "0123456789ABCDEF";
+    if (digits < 1) digits = 1;
+    if (digits > 8) digits = 8;
+    while (digits--) fmt_char(f, hex[(value >> (digits * 4)) & 0xF]);
+}
+
+void fmt_fixed(FmtBuf *f, int32_t value, int decimals) {
+    uint32_t scale = 1, mag;
+    for (int i = 0; i < decimals; i++) scale *= 10;
+    if (value < 0) {
+        fmt_char(f, '-');
+        mag = 0u - (uint32_t)value;
+    } else {
+        mag = value;
+    }
+    fmt_uint(f, mag / scale);
+    if (decimals > 0) {
+        fmt_char(f, '.');
+        fmt_uint_pad(f, mag % scale, decimals, '0');
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef FMT_H
+#define FMT_H
+
+#include <stdint.h>
+
+// Small formatter used instead of sprintf(). Text is appended to a caller
+// buffer that always stays NUL-terminated; output past the end is dropped.
+// No heap, no varargs, and only a few words of stack per call.
+
+typedef struct {
+    char *buf;      // Caller storage
+    int len;        // Characters written so far
+    int cap;        // Size of buf including the terminator
+} FmtBuf;
+
+void fmt_init(FmtBuf *f, char *buf, int cap);
+void fmt_char(FmtBuf *f, char c);
+void fmt_str(FmtBuf *f, const char *str);
+void fmt_str_pad(FmtBuf *f, const char *str, int width);        // Left aligned, space padded to width
+void fmt_int(FmtBuf *f, int32_t value);
+void fmt_uint(FmtBuf *f, uint32_t value);
+void fmt_uint_pad(FmtBuf *f, uint32_t value, int width, char pad); // Right aligned
+void fmt_hex(FmtBuf *f, uint32_t value, int digits);             // Upper case, zero padded
+void fmt_fixed(FmtBuf *f, int32_t value, int decimals);          // value scaled by 10^decimals
+
+#endif
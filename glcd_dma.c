@@ -0,0 +1,205 @@
+#include <LPC17xx.h>
+#include "cmsis_os.h"
+#include "GPDMA_LPC17xx.h"
+#include "glcd_dma.h"
+
+// Panel SPI protocol, same as the board driver: a start byte selects index
+// or data and read or write, then the 16-bit words follow MSB first
+#define SPI_START 0x70
+#define SPI_RD    0x01
+#define SPI_DATA  0x02
+
+#define LCD_CS (1 << 6)         // P0.6, SSEL1
+
+#define SSP_CR0_DSS 0x0F
+#define SSP_CR1_SSE (1 << 1)
+#define SSP_SR_TFE  (1 << 0)
+#define SSP_SR_RNE  (1 << 2)
+#define SSP_SR_BSY  (1 << 4)
+#define SSP_ICR_ROR (1 << 0)
+#define SSP_DMACR_TX (1 << 1)
+
+// GPDMA channel control and configuration fields (UM10360 chapter 31)
+#define DMA_CTRL_SWIDTH_16 (1UL << 18)
+#define DMA_CTRL_DWIDTH_16 (1UL << 21)
+#define DMA_CTRL_SI        (1UL << 26)
+#define DMA_CTRL_I         (1UL << 31)
+#define DMA_CFG_E          (1UL << 0)
+#define DMA_CFG_DEST_SSP1  (2UL << 6)  // SSP1 Tx request line
+#define DMA_CFG_M2P        (1UL << 11)
+#define DMA_CFG_IE         (1UL << 14)
+#define DMA_CFG_ITC        (1UL << 15)
+#define DMA_MAX_COUNT 4095             // Transfer size field is 12 bits
+
+osSemaphoreDef(glcd_dma_sem);
+static osSemaphoreId dma_idle;         // One token, held while a transfer runs
+static int himax;                      // HX8347-D instead of the ILI932x register set
+static uint32_t cs_pinsel;             // P0.6 function and SSP1 interrupt mask of the board driver
+static uint32_t ssp_imsc;
+static volatile int dma_active;
+
+static const uint16_t *dma_src;        // Next source pixel, NULL for fills
+static uint32_t dma_left;              // Pixels not yet queued
+static uint16_t fill_color;
+
+static uint8_t spi_tran(uint8_t byte) {
+    LPC_SSP1->DR = byte;
+    while (!(LPC_SSP1->SR & SSP_SR_RNE));
+    return LPC_SSP1->DR;
+}
+
+static void wr_cmd(uint8_t cmd) {
+    LPC_GPIO0->FIOCLR = LCD_CS;
+    spi_tran(SPI_START);
+    spi_tran(0);
+    spi_tran(cmd);
+    LPC_GPIO0->FIOSET = LCD_CS;
+}
+
+static void wr_reg(uint8_t reg, uint16_t val) {
+    wr_cmd(reg);
+    LPC_GPIO0->FIOCLR = LCD_CS;
+    spi_tran(SPI_START | SPI_DATA);
+    spi_tran(val >> 8);
+    spi_tran(val & 0xFF);
+    LPC_GPIO0->FIOSET = LCD_CS;
+}
+
+static uint16_t rd_reg(uint8_t reg) {
+    uint16_t val;
+
+    wr_cmd(reg);
+    LPC_GPIO0->FIOCLR = LCD_CS;
+    spi_tran(SPI_START | SPI_RD | SPI_DATA);
+    spi_tran(0); // Dummy byte
+    val = spi_tran(0) << 8;
+    val |= spi_tran(0);
+    LPC_GPIO0->FIOSET = LCD_CS;
+    return val;
+}
+
+// The board driver may run P0.6 as hardware SSEL, which would rise whenever
+// the FIFO runs dry. Drive it as GPIO while this module owns the bus and
+// keep the driver's SSP1 interrupts off so the echoed bytes do not reach it.
+static void bus_take(void) {
+    cs_pinsel = LPC_PINCON->PINSEL0 & (3 << 12);
+    ssp_imsc = LPC_SSP1->IMSC;
+    LPC_SSP1->IMSC = 0;
+    LPC_GPIO0->FIOSET = LCD_CS;
+    LPC_GPIO0->FIODIR |= LCD_CS;
+    LPC_PINCON->PINSEL0 &= ~(3 << 12);
+}
+
+static void bus_give(void) {
+    LPC_PINCON->PINSEL0 |= cs_pinsel;
+    LPC_SSP1->IMSC = ssp_imsc;
+}
+
+static void frame_bits(int bits) {
+    while (!(LPC_SSP1->SR & SSP_SR_TFE) || (LPC_SSP1->SR & SSP_SR_BSY));
+    LPC_SSP1->CR1 &= ~SSP_CR1_SSE;
+    LPC_SSP1->CR0 = (LPC_SSP1->CR0 & ~SSP_CR0_DSS) | (bits - 1);
+    LPC_SSP1->CR1 |= SSP_CR1_SSE;
+}
+
+// Same window mapping as the board driver in landscape mode
+static void set_window(int x, int y, int w, int h) {
+    int xe = x + w - 1, ye = y + h - 1;
+
+    if (himax) {
+        wr_reg(0x02, x >> 8);
+        wr_reg(0x03, x & 0xFF);
+        wr_reg(0x04, xe >> 8);
+        wr_reg(0x05, xe & 0xFF);
+        wr_reg(0x06, y >> 8);
+        wr_reg(0x07, y & 0xFF);
+        wr_reg(0x08, ye >> 8);
+        wr_reg(0x09, ye & 0xFF);
+    } else {
+        wr_reg(0x50, y);           // Horizontal GRAM start/end
+        wr_reg(0x51, ye);
+        wr_reg(0x52, 320 - x - w); // Vertical GRAM start/end, mirrored
+        wr_reg(0x53, 320 - x - 1);
+        wr_reg(0x20, y);           // GRAM address
+        wr_reg(0x21, 320 - x - 1);
+    }
+    wr_cmd(0x22);                  // Following data goes to GRAM
+}
+
+static void dma_event(uint32_t event);
+
+// Queues the next chunk, a single channel moves at most 4095 items
+static void dma_next(void) {
+    uint32_t n = dma_left > DMA_MAX_COUNT ? DMA_MAX_COUNT : dma_left;
+    uint32_t control = n | DMA_CTRL_SWIDTH_16 | DMA_CTRL_DWIDTH_16 | DMA_CTRL_I;
+    uint32_t src = (uint32_t)&fill_color;
+
+    if (dma_src != NULL) {
+        control |= DMA_CTRL_SI;
+        src = (uint32_t)dma_src;
+        dma_src += n;
+    }
+    dma_left -= n;
+    GPDMA_ChannelConfigure(GLCD_DMA_CHANNEL, src, (uint32_t)&LPC_SSP1->DR, n, control,
+                           DMA_CFG_E | DMA_CFG_DEST_SSP1 | DMA_CFG_M2P | DMA_CFG_IE | DMA_CFG_ITC,
+                           dma_event);
+}
+
+// GPDMA interrupt: chain the next chunk or close the transfer
+static void dma_event(uint32_t event) {
+    if (dma_left > 0 && !(event & GPDMA_EVENT_ERROR)) {
+        dma_next();
+        return;
+    }
+    frame_bits(8); // Waits for the last few words to leave the FIFO
+    LPC_SSP1->DMACR = 0;
+    while (LPC_SSP1->SR & SSP_SR_RNE) (void)LPC_SSP1->DR; // Drop the echoed bytes
+    LPC_SSP1->ICR = SSP_ICR_ROR;
+    LPC_GPIO0->FIOSET = LCD_CS;
+    bus_give();
+    dma_active = 0;
+    osSemaphoreRelease(dma_idle);
+}
+
+static void dma_start(int x, int y, int w, int h, const uint16_t *pixels, uint32_t color) {
+    if (w <= 0 || h <= 0) return;
+    osSemaphoreWait(dma_idle, osWaitForever);
+    dma_active = 1;
+    dma_src = pixels;
+    dma_left = (uint32_t)w * h;
+    fill_color = (uint16_t)color;
+    bus_take();
+    set_window(x, y, w, h);
+    LPC_GPIO0->FIOCLR = LCD_CS;
+    spi_tran(SPI_START | SPI_DATA);
+    frame_bits(16); // One SSP frame per pixel keeps RGB565 MSB first
+    LPC_SSP1->DMACR = SSP_DMACR_TX;
+    dma_next();
+}
+
+int glcd_dma_init(void) {
+    dma_idle = osSemaphoreCreate(osSemaphore(glcd_dma_sem), 1);
+    if (dma_idle == NULL || GPDMA_Initialize() != 0) return -1;
+    bus_take();
+    himax = rd_reg(0x00) == 0x47; // Same probe the board driver uses
+    bus_give();
+    return 0;
+}
+
+void glcd_dma_fill(int x, int y, int w, int h, uint32_t color) {
+    dma_start(x, y, w, h, NULL, color);
+}
+
+void glcd_dma_blit(int x, int y, int w, int h, const uint16_t *pixels) {
+    dma_start(x, y, w, h, pixels, 0);
+}
+
+void glcd_dma_wait(void) {
+    if (!dma_active) return;
+    osSemaphoreWait(dma_idle, osWaitForever);
+    osSemaphoreRelease(dma_idle);
+}
+
+int glcd_dma_busy(void) {
+    return dma_active;
+}
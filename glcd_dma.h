@@ -0,0 +1,25 @@
+#ifndef GLCD_DMA_H
+#define GLCD_DMA_H
+
+#include <stdint.h>
+
+// Bulk pixel path for the MCB1700 panel. The board GLCD driver pushes each
+// pixel through its own SPI call; here whole rectangles are queued to SSP1
+// through GPDMA and the call returns as soon as the transfer has started.
+// One transfer is in flight at a time: the next fill/blit, or
+// glcd_dma_wait(), blocks until the previous one is done.
+//
+// Coordinates are landscape pixels as used by Board_GLCD. Colours take the
+// same values as GLCD_SetBackgroundColor(), the panel keeps the low 16 bits
+// (RGB565). Callers hold glcd_mutex and call glcd_dma_wait() before going
+// back to the board driver, which shares SSP1.
+
+#define GLCD_DMA_CHANNEL 7      // Lowest priority GPDMA channel, not used by the RTE drivers
+
+int glcd_dma_init(void);        // After GLCD_Initialize(), 0 on success
+void glcd_dma_fill(int x, int y, int w, int h, uint32_t color);
+void glcd_dma_blit(int x, int y, int w, int h, const uint16_t *pixels); // pixels must stay valid until done
+void glcd_dma_wait(void);
+int glcd_dma_busy(void);
+
+#endif
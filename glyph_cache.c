@@ -0,0 +1,68 @@
+#include <stddef.h>
+#include "glyph_cache.h"
+
+#define GLYPH_W 16
+#define GLYPH_H 24
+
+typedef struct {
+    uint16_t fg, bg;
+    char ch;                        // 0 while the slot is empty
+    uint32_t used;                  // Stamp of the last lookup, for LRU
+} GlyphSlot;
+
+// Zero-init section placed at the start of AHB SRAM bank 0
+static uint16_t glyph_pixels[GLYPH_SLOTS][GLYPH_W * GLYPH_H]
+    __attribute__((section(".bss.ARM.__at_0x2007C000")));
+static GlyphSlot slots[GLYPH_SLOTS];
+static const GLCD_FONT *glyph_font;
+static uint32_t stamp;
+
+uint32_t glyph_hits, glyph_misses;
+
+void glyph_cache_init(const GLCD_FONT *font) {
+    glyph_font = font;
+    for (int i = 0; i < GLYPH_SLOTS; i++) slots[i].ch = 0;
+}
+
+static int cacheable(char c) {
+    return c == ' ' || c == ':' || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z');
+}
+
+// Same expansion as GLCD_DrawChar(): rows of (width + 7) / 8 bytes, LSB is
+// the leftmost pixel
+static void render(uint16_t *out, char c, uint16_t fg, uint16_t bg) {
+    const uint8_t *bits = glyph_font->bitmap + (uint32_t)(c - glyph_font->offset) * (GLYPH_W / 8) * GLYPH_H;
+
+    for (int y = 0; y < GLYPH_H; y++) {
+        for (int x = 0; x < GLYPH_W; x++) {
+            *out++ = (bits[x >> 3] >> (x & 7)) & 1 ? fg : bg;
+        }
+        bits += GLYPH_W / 8;
+    }
+}
+
+const uint16_t *glyph_cache_get(char c, uint32_t fg, uint32_t bg) {
+    int victim = 0;
+
+    if (glyph_font == NULL || glyph_font->width != GLYPH_W || glyph_font->height != GLYPH_H || !cacheable(c))
+        return NULL;
+    stamp++;
+    for (int i = 0; i < GLYPH_SLOTS; i++) {
+        GlyphSlot *s = &slots[i];
+        if (s->ch == c && s->fg == (uint16_t)fg && s->bg == (uint16_t)bg) {
+            s->used = stamp;
+            glyph_hits++;
+            return glyph_pixels[i];
+        }
+        if (s->ch == 0 || (slots[victim].ch != 0 && s->used < slots[victim].used)) victim = i;
+    }
+    // The glyph still being sent is the most recently used one, so the
+    // victim is never a buffer that a transfer is reading
+    glyph_misses++;
+    render(glyph_pixels[victim], c, fg, bg);
+    slots[victim].ch = c;
+    slots[victim].fg = fg;
+    slots[victim].bg = bg;
+    slots[victim].used = stamp;
+    return glyph_pixels[victim];
+}
@@ -0,0 +1,27 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <stdint.h>
+#include "Board_GLCD.h"
+
+// Cache of font glyphs already expanded to RGB565 for one foreground and
+// background pair, so redrawing a character is a single block transfer
+// instead of a bit-by-bit expansion. Only the characters screens use all
+// the time are cached (space, ':', digits and capitals); the least recently
+// used glyph is dropped when the cache is full.
+//
+// The pixel store lives in AHB SRAM bank 0, which nothing else uses, so the
+// cache costs no main SRAM beyond its small index.
+
+#define GLYPH_SLOTS 20              // 20 * 16 * 24 * 2 = 15 kB of the 16 kB bank
+
+void glyph_cache_init(const GLCD_FONT *font);
+
+// Returns the pixels of c drawn in fg on bg, or NULL if c is not cached.
+// Colours are passed as to GLCD_SetForegroundColor(). The buffer stays
+// valid until the next call, so a transfer of it may still be running.
+const uint16_t *glyph_cache_get(char c, uint32_t fg, uint32_t bg);
+
+extern uint32_t glyph_hits, glyph_misses;
+
+#endif
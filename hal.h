@@ -0,0 +1,53 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+// Hardware layer under main.c. The implementation is picked at compile time:
+// the firmware build gets hal_lpc17xx.h, a build with HAL_HOST defined gets
+// host/hal/hal_host.h, which runs the same main.c logic on Linux. Both
+// provide the functions below as static inline, so a call with a constant
+// port or output compiles to the register access itself, as before, with no
+// function pointer or switch left at run time.
+//
+//   ADC      void hal_adc_init(void);
+//            int hal_adc_read(int channel);        // 12-bit, waits for the conversion
+//   GPIO     void hal_gpio_init(void);             // Outputs cleared, then enabled
+//            int hal_out_get(int out);             // HAL_HEATER ...
+//            void hal_out_set(int out, int on);
+//   Keys     void hal_keys_init(void);
+//            uint32_t hal_keys(void);              // Joystick switches closed, KEY_ bits, not debounced
+//   UART     void hal_uart_init(int port);         // HAL_UART_CONSOLE or HAL_UART_RS485
+//            void hal_uart_putc(int port, char c); // Waits for room in the FIFO
+//            int hal_uart_getc(int port);          // Next received byte, -1 when none
+//            int hal_uart_errors(int port);        // Overrun, parity or framing error seen
+//   Time     void hal_time_init(void);             // Cycle counter running
+//            uint32_t hal_clock_hz(void);
+//            uint32_t hal_cycles(void);            // Wraps, subtract two readings
+//            uint32_t hal_us(void);                // Since hal_time_init()
+//   Display  void hal_display_init(void);          // Slow, from Render_Thread
+//            void hal_display_char(int x, int y, char c, uint32_t fg, uint32_t bg);
+//            void hal_display_fill(int x, int y, int w, int h, uint32_t color);
+//            void hal_display_blit(int x, int y, int w, int h, const uint16_t *pixels);
+//            void hal_display_line(int y, const char *text, uint32_t fg, uint32_t bg);
+//            void hal_display_wait(void);          // Last transfer done, pixels free
+//            void hal_display_power(int level);    // HAL_DISPLAY_OFF ...
+//            uint32_t hal_display_cache_pct(void); // Glyph cache hit rate
+//
+// Colours are 0xRRGGBB as for Board_GLCD, pixels RGB565. Display calls are
+// made under glcd_mutex.
+
+enum { HAL_HEATER, HAL_SPRINKLER, HAL_LIGHT, HAL_STATUS_LED, HAL_OUTPUTS }; // Actuators first, by actuator index
+enum { HAL_UART_CONSOLE, HAL_UART_RS485 };
+enum { HAL_DISPLAY_OFF, HAL_DISPLAY_DIM, HAL_DISPLAY_ON };
+
+#define HAL_DISPLAY_WIDTH 320
+#define HAL_DISPLAY_HEIGHT 240
+
+#ifdef HAL_HOST
+#include "hal_host.h"
+#else
+#include "hal_lpc17xx.h"
+#endif
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef HAL_LPC17XX_H
+#define HAL_LPC17XX_H
+
+#include <LPC17xx.h>
+#include "Board_GLCD.h"
+#include "glcd_dma.h"
+#include "glyph_cache.h"
+#include "compose.h"
+
+// LPC1768 / MCB1700 implementation of hal.h, included from there only.
+//
+//   ADC      AD0.0-AD0.2 on P0.23-P0.25, one software-started conversion at a time
+//   Outputs  heater P1.29, sprinkler P1.31, light P2.2, status LED P1.28
+//   Keys     joystick on P1.20 and P1.23-P1.26, closed to ground
+//   UART     console on UART0 (P0.2/P0.3, 9600), RS-485 on UART1 (P2.0/P2.1)
+//   Time     DWT cycle counter at SystemCoreClock
+//   Display  Board_GLCD on SSP1, bulk pixels through glcd_dma, backlight P4.28
+
+extern GLCD_FONT GLCD_Font_16x24;
+
+// UART1 drives the RS-485 transceiver. DTR1 (P2.5) is the driver enable and
+// is switched by the UART itself: raised when a byte is loaded and dropped
+// RS485_DE_DELAY bit times after the last stop bit, so the bus is released
+// without any software timing.
+#define CONSOLE_DLL 97            // 9600 baud
+#define RS485_DLL 24              // 38400 baud with the same PCLK as UART0
+#define RS485_DE_DELAY 2          // Bit times DE stays asserted after a frame
+
+#define BACKLIGHT_PIN (1 << 28)   // P4.28, MAT2.0 when dimmed
+#define BACKLIGHT_DIM_HZ 1000     // Timer2 toggles MAT2.0 for a 50% duty cycle
+#define PCONP_TIM2 (1 << 22)
+#define PCONP_SSP1 (1 << 10)
+
+static inline void hal_adc_init(void) {
+    LPC_PINCON->PINSEL1 |= (1 << 14) | (1 << 16) | (1 << 18); // Configure AD0.0-0.2 (P0.23-25)
+    LPC_SC->PCONP |= (1 << 12); // Enable ADC power
+    LPC_ADC->ADCR = (7 << 0) | (4 << 8) | (1 << 21); // Enable 3 channels, set clock division, power ON
+}
+
+static inline int hal_adc_read(int channel) {
+    LPC_ADC->ADCR &= ~(0x7 << 0); // Clear channel selection
+    LPC_ADC->ADCR |= (1 << channel); // Select the specified channel
+    LPC_ADC->ADCR |= (1 << 24); // Start conversion
+    while (!(LPC_ADC->ADGDR & (1U << 31))); // Wait for conversion to complete
+    return (LPC_ADC->ADGDR >> 4) & 0xFFF; // Extract 12-bit ADC result
+}
+
+// The pins come out of reset as inputs with pull-ups, so the outputs are
+// cleared before they are enabled and start driving low
+static inline void hal_gpio_init(void) {
+    LPC_GPIO1->FIOCLR = (1 << 29) | (1U << 31) | (1 << 28); // Heater, sprinkler and status LED off
+    LPC_GPIO2->FIOCLR = (1 << 2); // Light off
+    LPC_GPIO1->FIODIR |= (1 << 29) | (1U << 31) | (1 << 28); // Set P1.29 (heater), P1.31 (sprinkler), P1.28 (status LED) as outputs
+    LPC_GPIO2->FIODIR |= (1 << 2); // Set P2.2 (light) as output
+}
+
+static inline int hal_out_get(int out) {
+    switch (out) {
+        case HAL_HEATER: return (LPC_GPIO1->FIOPIN & (1 << 29)) ? 1 : 0;
+        case HAL_SPRINKLER: return (LPC_GPIO1->FIOPIN & (1U << 31)) ? 1 : 0;
+        case HAL_LIGHT: return (LPC_GPIO2->FIOPIN & (1 << 2)) ? 1 : 0;
+        case HAL_STATUS_LED: return (LPC_GPIO1->FIOPIN & (1 << 28)) ? 1 : 0;
+    }
+    return 0;
+}
+
+static inline void hal_out_set(int out, int on) {
+    switch (out) {
+        case HAL_HEATER:
+            if (on) LPC_GPIO1->FIOSET = (1 << 29); else LPC_GPIO1->FIOCLR = (1 << 29);
+            break;
+        case HAL_SPRINKLER:
+            if (on) LPC_GPIO1->FIOSET = (1U << 31); else LPC_GPIO1->FIOCLR = (1U << 31);
+            break;
+        case HAL_LIGHT:
+            if (on) LPC_GPIO2->FIOSET = (1 << 2); else LPC_GPIO2->FIOCLR = (1 << 2);
+            break;
+        case HAL_STATUS_LED:
+            if (on) LPC_GPIO1->FIOSET = (1 << 28); else LPC_GPIO1->FIOCLR = (1 << 28);
+            break;
+    }
+}
+
+static inline void hal_keys_init(void) {
+    LPC_PINCON->PINSEL3 &= ~((3 << 14) | (3 << 18) | (3 << 8) | (3 << 16) | (3 << 20)); // P1.20, P1.23..26 as GPIO
+    LPC_PINCON->PINMODE3 &= ~((3 << 14) | (3 << 18) | (3 << 8) | (3 << 16) | (3 << 20)); // Pull-ups
+    LPC_GPIO1->FIODIR &= ~((1 << 20) | (0xF << 23));
+}
+
+static inline uint32_t hal_keys(void) {
+    uint32_t pins = ~LPC_GPIO1->FIOPIN; // Switches pull to ground
+    return ((pins >> 23) & 1) |        // KEY_UP
+           ((pins >> 25) & 1) << 1 |   // KEY_DOWN
+           ((pins >> 20) & 1) << 2 |   // KEY_CENTER
+           ((pins >> 24) & 1) << 3 |   // KEY_LEFT
+           ((pins >> 26) & 1) << 4;    // KEY_RIGHT
+}
+
+static inline void hal_uart_init(int port) {
+    if (port == HAL_UART_CONSOLE) {
+        LPC_SC->PCONP |= (1 << 3); // Power up UART0
+        LPC_PINCON->PINSEL0 |= (1 << 4) | (1 << 6); // Configure P0.2 as TXD0 and P0.3 as RXD0
+        LPC_UART0->LCR = 0x83; // 8 bits, 1 stop bit, enable DLAB
+        LPC_UART0->DLM = 0; LPC_UART0->DLL = CONSOLE_DLL;
+        LPC_UART0->LCR = 0x03; // 8 bits, 1 stop bit, no parity
+        LPC_UART0->FCR = 0x07; // Enable and reset FIFOs so polling does not drop bytes
+    } else {
+        LPC_SC->PCONP |= (1 << 4); // Power up UART1
+        LPC_PINCON->PINSEL4 &= ~((3 << 0) | (3 << 2) | (3 << 10));
+        LPC_PINCON->PINSEL4 |= (2 << 0) | (2 << 2) | (2 << 10); // P2.0 TXD1, P2.1 RXD1, P2.5 DTR1
+        LPC_UART1->LCR = 0x83; // 8 bits, 1 stop bit, enable DLAB
+        LPC_UART1->DLM = 0; LPC_UART1->DLL = RS485_DLL;
+        LPC_UART1->LCR = 0x03; // 8 bits, 1 stop bit, no parity
+        LPC_UART1->FCR = 0x07; // Enable and reset FIFOs
+        LPC_UART1->RS485CTRL = (1 << 3) | (1 << 4) | (1 << 5); // DTR pin, auto direction, DE high while sending
+        LPC_UART1->RS485DLY = RS485_DE_DELAY;
+    }
+}
+
+// UART1 has its own register layout in LPC17xx.h, but LSR, THR and RBR sit
+// at the same offsets as on UART0
+static inline void hal_uart_putc(int port, char c) {
+    if (port == HAL_UART_CONSOLE) {
+        while (!(LPC_UART0->LSR & (1 << 5))); // Wait for TX ready
+        LPC_UART0->THR = c;
+    } else {
+        while (!(LPC_UART1->LSR & (1 << 5)));
+        LPC_UART1->THR = c;
+    }
+}
+
+static inline int hal_uart_getc(int port) {
+    if (port == HAL_UART_CONSOLE) return (LPC_UART0->LSR & 0x01) ? LPC_UART0->RBR : -1;
+    return (LPC_UART1->LSR & 0x01) ? LPC_UART1->RBR : -1;
+}
+
+static inline int hal_uart_errors(int port) {
+    return ((port == HAL_UART_CONSOLE ? LPC_UART0->LSR : LPC_UART1->LSR) & 0x0E) != 0; // Reading LSR clears them
+}
+
+static inline void hal_time_init(void) {
+    SystemCoreClockUpdate(); // Update the system clock frequency
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t hal_clock_hz(void) {
+    return SystemCoreClock;
+}
+
+static inline uint32_t hal_cycles(void) {
+    return DWT->CYCCNT;
+}
+
+static inline uint32_t hal_us(void) {
+    return DWT->CYCCNT / (SystemCoreClock / 1000000);
+}
+
+static inline void hal_display_init(void) {
+    GLCD_Initialize();
+    glcd_dma_init();      // Bulk fills over GPDMA
+    glyph_cache_init(&GLCD_Font_16x24);
+    compose_init(&GLCD_Font_16x24);
+    GLCD_SetFont(&GLCD_Font_16x24);
+}
+
+// Cached glyphs go out through GPDMA and return at once, other characters
+// use the board driver, which first waits for the bus to be free
+static inline void hal_display_char(int x, int y, char c, uint32_t fg, uint32_t bg) {
+    const uint16_t *pixels = glyph_cache_get(c, fg, bg);
+
+    if (pixels != NULL) {
+        glcd_dma_blit(x, y, 16, 24, pixels);
+    } else {
+        glcd_dma_wait();
+        GLCD_SetForegroundColor(fg);
+        GLCD_SetBackgroundColor(bg);
+        GLCD_DrawChar(x, y, c);
+    }
+}
+
+static inline void hal_display_fill(int x, int y, int w, int h, uint32_t color) {
+    glcd_dma_fill(x, y, w, h, color);
+}
+
+static inline void hal_display_blit(int x, int y, int w, int h, const uint16_t *pixels) {
+    glcd_dma_blit(x, y, w, h, pixels);
+}
+
+// One 24-pixel text row in a single pass: the text, then background to the
+// right edge
+static inline void hal_display_line(int y, const char *text, uint32_t fg, uint32_t bg) {
+    ComposeSpan span = { 0, HAL_DISPLAY_WIDTH, text, fg, bg };
+    compose_region(y, 24, bg, &span, 1);
+}
+
+static inline void hal_display_wait(void) {
+    glcd_dma_wait();
+}
+
+// Off also powers SSP1 down; the panel keeps its picture in GRAM. Dimmed is
+// Timer2 toggling MAT2.0 on the backlight pin.
+static inline void hal_display_power(int level) {
+    if (level == HAL_DISPLAY_OFF) {
+        glcd_dma_wait();
+        LPC_SC->PCONP &= ~PCONP_SSP1;
+    } else {
+        LPC_SC->PCONP |= PCONP_SSP1;
+    }
+    if (level == HAL_DISPLAY_DIM) {
+        LPC_SC->PCONP |= PCONP_TIM2;
+        LPC_TIM2->TCR = 2;                  // Hold in reset while setting up
+        LPC_TIM2->MR0 = SystemCoreClock / 4 / (2 * BACKLIGHT_DIM_HZ); // PCLK is CCLK/4
+        LPC_TIM2->MCR = 1 << 1;             // Reset on MR0
+        LPC_TIM2->EMR = 3 << 4;             // Toggle MAT2.0 on MR0
+        LPC_TIM2->TCR = 1;
+        LPC_PINCON->PINSEL9 = (LPC_PINCON->PINSEL9 & ~(3 << 24)) | (2 << 24);
+    } else {
+        LPC_PINCON->PINSEL9 &= ~(3 << 24);  // Back to GPIO
+        LPC_GPIO4->FIODIR |= BACKLIGHT_PIN;
+        if (level == HAL_DISPLAY_ON) LPC_GPIO4->FIOSET = BACKLIGHT_PIN; else LPC_GPIO4->FIOCLR = BACKLIGHT_PIN;
+        if (LPC_SC->PCONP & PCONP_TIM2) {   // Timer2 registers only while it has power
+            LPC_TIM2->TCR = 0;
+            LPC_SC->PCONP &= ~PCONP_TIM2;
+        }
+    }
+}
+
+static inline uint32_t hal_display_cache_pct(void) {
+    return glyph_hits * 100 / (glyph_hits + glyph_misses + 1);
+}
+
+#endif
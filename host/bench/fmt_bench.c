@@ -0,0 +1,90 @@
+// Host benchmark of fmt.c against snprintf() on the lines the firmware builds.
+//
+//   gcc -O2 -I../.. fmt_bench.c ../../fmt.c -o fmt_bench && ./fmt_bench
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "fmt.h"
+
+#define ITERATIONS 2000000
+
+static volatile int sink;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void telemetry_fmt(char *out, int size, int t, int m, int l) {
+    FmtBuf f;
+    fmt_init(&f, out, size);
+    fmt_str(&f, "TEMP:");
+    fmt_int(&f, t);
+    fmt_str(&f, "|MOIST:");
+    fmt_int(&f, m);
+    fmt_str(&f, "|LIGHT:");
+    fmt_int(&f, l);
+    fmt_char(&f, '\n');
+}
+
+static void telemetry_printf(char *out, int size, int t, int m, int l) {
+    snprintf(out, size, "TEMP:%d|MOIST:%d|LIGHT:%d\n", t, m, l);
+}
+
+static void threshold_fmt(char *out, int size, int v) {
+    FmtBuf f;
+    fmt_init(&f, out, size);
+    fmt_str(&f, "Threshold: ");
+    fmt_int(&f, v);
+}
+
+static void threshold_printf(char *out, int size, int v) {
+    snprintf(out, size, "Threshold: %d", v);
+}
+
+static void fault_fmt(char *out, int size, int v) {
+    FmtBuf f;
+    fmt_init(&f, out, size);
+    fmt_str(&f, "FAULT:");
+    fmt_hex(&f, v, 2);
+    fmt_char(&f, '\n');
+}
+
+static void fault_printf(char *out, int size, int v) {
+    snprintf(out, size, "FAULT:%02X\n", v);
+}
+
+int main(void) {
+    char buf[64];
+    double t0, t1;
+
+    t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) { telemetry_fmt(buf, sizeof(buf), i & 0xFFF, 4095 - (i & 0xFFF), i & 0x7FF); sink += buf[6]; }
+    t1 = now_ns();
+    printf("telemetry  fmt      %6.1f ns/call\n", (t1 - t0) / ITERATIONS);
+    t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) { telemetry_printf(buf, sizeof(buf), i & 0xFFF, 4095 - (i & 0xFFF), i & 0x7FF); sink += buf[6]; }
+    t1 = now_ns();
+    printf("telemetry  snprintf %6.1f ns/call\n", (t1 - t0) / ITERATIONS);
+
+    t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) { threshold_fmt(buf, sizeof(buf), i & 0xFFF); sink += buf[12]; }
+    t1 = now_ns();
+    printf("threshold  fmt      %6.1f ns/call\n", (t1 - t0) / ITERATIONS);
+    t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) { threshold_printf(buf, sizeof(buf), i & 0xFFF); sink += buf[12]; }
+    t1 = now_ns();
+    printf("threshold  snprintf %6.1f ns/call\n", (t1 - t0) / ITERATIONS);
+
+    t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) { fault_fmt(buf, sizeof(buf), i & 0xFF); sink += buf[6]; }
+    t1 = now_ns();
+    printf("fault      fmt      %6.1f ns/call\n", (t1 - t0) / ITERATIONS);
+    t0 = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) { fault_printf(buf, sizeof(buf), i & 0xFF); sink += buf[6]; }
+    t1 = now_ns();
+    printf("fault      snprintf %6.1f ns/call\n", (t1 - t0) / ITERATIONS);
+    return 0;
+}
@@ -0,0 +1,445 @@
+// End-to-end control latency benchmark. Drives a board, or greenhouse_sim
+// through its terminal, in replay mode: ADC commands play sensor scans that
+// cross the thresholds the board is set to, and the LAT stream of main.c
+// reports the time from each crossing scan to the output switching on,
+// taken with the DWT cycle counter on the board and the monotonic clock in
+// the simulation. Each case runs under a UI load of synthetic key presses
+// (KEY_TEST) and a telemetry load of the ACT, FAULT, FILT and STATS streams
+// at one period, and the report gives the latency percentiles of each case
+// per actuator as JSON, to keep and compare across releases.
+//
+// Scans are sent at random intervals around the sensor period, so the
+// crossings fall at every phase of the monitor threads' 1 s poll. Each round
+// crosses a random set of the actuators at once, which then contend for
+// adc_mutex, holds the crossing readings until all of them have switched or
+// ROUND_TIMEOUT_MS has passed, and goes back below the thresholds for a scan
+// or two. ADC commands that reach the board while Sensor_Thread is held up
+// replace one another, so a round only starts once a scan below the
+// thresholds has been read, which the scan numbers in the ACK:ADC replies
+// show. Actuators whose threshold no sensor reading can cross are skipped;
+// thresholds and saved settings are left as they are.
+//
+//   gcc -O2 latency_bench.c -o latency_bench
+//   ./latency_bench [-n rounds] [-u hz,...] [-t ms,...] [-s ms] [-r seed] [-l label] [-o report.json] /dev/ttyUSB0
+//
+//   -n  rounds per case (60)
+//   -u  UI loads, synthetic key presses per second (0)
+//   -t  telemetry loads, stream period in ms, 0 for none (0)
+//   -s  mean interval between scans (1000)
+//   -r  seed for the scan timing and the actuators crossed (1)
+//   -l  label for the report, the release or build measured
+//   -o  report file (stdout)
+//
+// Every combination of -u and -t is one case, so -u 0,10 -t 0,100 runs four.
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BAUD B9600              // UART0, CONSOLE_DLL in hal_lpc17xx.h
+#define REPLY_MS 1000           // Wait for each command reply
+#define SETTLE_MS 1500          // After changing the load, before the first round
+#define ROUND_TIMEOUT_MS 10000  // Crossings not acted on by then are lost
+#define LAT_PERIOD_MS 250       // LAT stream period, well under a scan
+#define MARGIN 100              // Counts beyond the threshold either way
+#define ADC_MAX 0xFFE           // 0 and 0xFFF read as sensor faults
+#define MAX_LOADS 8
+#define MAX_ROUNDS 10000
+
+static const char *const names[3] = { "heater", "sprinkler", "light" };
+static const char *const thresholds[3] = { "HEATER_TH", "SPRINKLER_TH", "LIGHT_TH" };
+static const char *const telemetry[] = { "ACT", "FAULT", "FILT", "STATS" };
+#define TELEMETRY (int)(sizeof(telemetry) / sizeof(telemetry[0]))
+
+typedef struct {
+    int fd;
+    char buf[512];
+    int len;
+} Serial;
+
+typedef struct {
+    int ui_hz, telemetry_ms;
+    int crossings[3], lost[3];
+    int n[3];
+    unsigned *us[3];            // Samples per actuator, MAX_ROUNDS each
+    int stray;                  // Samples for actuators not crossing at the time
+} Case;
+
+static volatile sig_atomic_t stop;
+static uint32_t rng;
+static int baseline[3], crossing[3]; // Readings below and beyond each threshold
+static int crossable;           // Bit n: actuator n can be crossed
+
+// Scans sent and not acknowledged yet, oldest first, each the actuators it
+// crossed. When the reply to a scan carries a later scan number than the
+// reply before, Sensor_Thread read the scan before in between.
+#define UNACKED 16
+static int unacked[UNACKED], unacked_count;
+static int last_acked = -1;     // Crossings of the scan acknowledged last, -1 for none
+static unsigned last_seq;
+static int baselines_read;      // Scans with no crossing read so far
+
+static void on_signal(int sig) {
+    stop = 1;
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t rand_next(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static int serial_open(Serial *s, const char *path) {
+    struct termios tio;
+
+    s->len = 0;
+    s->fd = open(path, O_RDWR | O_NOCTTY);
+    if (s->fd < 0 || tcgetattr(s->fd, &tio) < 0) {
+        perror(path);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, BAUD);
+    cfsetospeed(&tio, BAUD);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(s->fd, TCSANOW, &tio);
+    tcflush(s->fd, TCIOFLUSH);
+    return 0;
+}
+
+static void serial_send(Serial *s, const char *line) {
+    if (write(s->fd, line, strlen(line)) < 0 || write(s->fd, "\n", 1) < 0) perror("write");
+}
+
+// Next complete line from the board without its line end, waiting until
+// deadline. Returns 1 with a line, 0 on timeout.
+static int serial_line(Serial *s, char *line, int size, uint64_t deadline) {
+    while (1) {
+        char *nl = memchr(s->buf, '\n', s->len);
+        if (nl != NULL) {
+            int n = nl - s->buf, copy = n < size - 1 ? n : size - 1;
+            memcpy(line, s->buf, copy);
+            line[copy] = '\0';
+            if (copy > 0 && line[copy - 1] == '\r') line[copy - 1] = '\0';
+            s->len -= n + 1;
+            memmove(s->buf, nl + 1, s->len);
+            return 1;
+        }
+        if (s->len == sizeof(s->buf)) s->len = 0; // Garbage without newline
+
+        uint64_t now = now_ms();
+        if (now >= deadline || stop) return 0;
+        struct timeval tv = { (deadline - now) / 1000, (deadline - now) % 1000 * 1000 };
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(s->fd, &fds);
+        if (select(s->fd + 1, &fds, NULL, NULL, &tv) <= 0) continue;
+        int n = read(s->fd, s->buf + s->len, sizeof(s->buf) - s->len);
+        if (n > 0) s->len += n;
+    }
+}
+
+// Sends a command and waits for its ACK or NAK, skipping stream lines.
+// Returns 1 for ACK, with the reply in reply if given.
+static int command(Serial *s, const char *cmd, char *reply, int size) {
+    char line[256];
+    uint64_t deadline = now_ms() + REPLY_MS;
+
+    serial_send(s, cmd);
+    while (serial_line(s, line, sizeof(line), deadline)) {
+        if (strncmp(line, "ACK:", 4) != 0 && strncmp(line, "NAK:", 4) != 0) continue;
+        if (strncmp(line, "ACK:ADC:", 8) == 0) continue; // A scan still on its way
+        if (reply != NULL) snprintf(reply, size, "%s", line);
+        return line[0] == 'A';
+    }
+    if (reply != NULL) snprintf(reply, size, "no reply");
+    return 0;
+}
+
+static int get_param(Serial *s, const char *name, int *value) {
+    char cmd[64], reply[256];
+
+    snprintf(cmd, sizeof(cmd), "GET:%s", name);
+    if (!command(s, cmd, reply, sizeof(reply))) return -1;
+    *value = atoi(reply + 5 + strlen(name)); // ACK:<name>:<value>
+    return 0;
+}
+
+// Readings on either side of each threshold, as the monitor threads test
+// them: the heater switches on at or above, the others at or below
+static void plan_readings(const int th[3]) {
+    for (int i = 0; i < 3; i++) {
+        int below = th[i] - MARGIN, above = th[i] + MARGIN;
+        if (below < 1) below = 1;
+        if (above > ADC_MAX) above = ADC_MAX;
+        if (i == 0) {
+            baseline[i] = below;
+            crossing[i] = above;
+            if (below < th[i] && above >= th[i]) crossable |= 1 << i;
+        } else {
+            baseline[i] = above;
+            crossing[i] = below;
+            if (above > th[i] && below <= th[i]) crossable |= 1 << i;
+        }
+        if (!(crossable & (1 << i))) baseline[i] = i == 0 ? 1 : ADC_MAX; // As far off as it goes
+    }
+}
+
+static void send_scan(Serial *s, int crossed) {
+    char cmd[64];
+    int v[3];
+
+    for (int i = 0; i < 3; i++) v[i] = crossed & (1 << i) ? crossing[i] : baseline[i];
+    snprintf(cmd, sizeof(cmd), "ADC:%d:%d:%d", v[0], v[1], v[2]);
+    serial_send(s, cmd);
+    if (unacked_count < UNACKED) unacked[unacked_count++] = crossed;
+}
+
+static void scan_acked(unsigned seq) {
+    if (unacked_count == 0) return;
+    if (last_acked == 0 && seq != last_seq) baselines_read++;
+    last_acked = unacked[0];
+    last_seq = seq;
+    memmove(unacked, unacked + 1, --unacked_count * sizeof(unacked[0]));
+}
+
+static uint64_t scan_interval(int scan_ms) {
+    return scan_ms / 2 + rand_next() % (scan_ms + 1);
+}
+
+// Reads lines until deadline, taking LAT samples for the actuators in
+// *waiting into c and clearing their bits
+static void collect(Serial *s, Case *c, int *waiting, uint64_t deadline) {
+    char line[256];
+    unsigned seq, act, us;
+
+    while (serial_line(s, line, sizeof(line), deadline)) {
+        if (sscanf(line, "ACK:ADC:%u", &seq) == 1) scan_acked(seq);
+        if (sscanf(line, "LAT:%u:%u:%u", &seq, &act, &us) != 3 || act > 2) continue;
+        if (*waiting & (1 << act)) {
+            c->us[act][c->n[act]++] = us;
+            *waiting &= ~(1 << act);
+            if (*waiting == 0) return;
+        } else {
+            c->stray++;
+        }
+    }
+}
+
+static void run_case(Serial *s, Case *c, int rounds, int scan_ms) {
+    char cmd[64];
+    int waiting = 0;
+
+    snprintf(cmd, sizeof(cmd), "SET:KEY_TEST:%d", c->ui_hz);
+    command(s, cmd, NULL, 0);
+    for (int i = 0; i < TELEMETRY; i++) {
+        if (c->telemetry_ms > 0) snprintf(cmd, sizeof(cmd), "SUB:%s:%d", telemetry[i], c->telemetry_ms);
+        else snprintf(cmd, sizeof(cmd), "UNSUB:%s", telemetry[i]);
+        command(s, cmd, NULL, 0);
+    }
+    unacked_count = 0;
+    last_acked = -1;
+    send_scan(s, 0);
+    collect(s, c, &waiting, now_ms() + SETTLE_MS); // Samples left from before only count as stray
+    c->stray = 0;
+
+    for (int r = 0; r < rounds && !stop; r++) {
+        int crossed;
+        uint64_t end = now_ms() + ROUND_TIMEOUT_MS;
+
+        do crossed = rand_next() & crossable; while (crossed == 0);
+        waiting = crossed;
+        for (int i = 0; i < 3; i++) c->crossings[i] += (crossed >> i) & 1;
+        while (waiting && !stop && now_ms() < end) {
+            uint64_t next = now_ms() + scan_interval(scan_ms);
+            send_scan(s, crossed); // Held as a sensor would keep reading it
+            collect(s, c, &waiting, next < end ? next : end);
+        }
+        for (int i = 0; i < 3; i++) c->lost[i] += (waiting >> i) & 1;
+
+        int settle = 1 + rand_next() % 2;
+        waiting = 0;
+        baselines_read = 0;
+        end = now_ms() + ROUND_TIMEOUT_MS;
+        while (baselines_read < settle && !stop && now_ms() < end) {
+            uint64_t next = now_ms() + scan_interval(scan_ms);
+            send_scan(s, 0);
+            collect(s, c, &waiting, next);
+        }
+        fprintf(stderr, "\rui %d/s telemetry %d ms: round %d of %d", c->ui_hz, c->telemetry_ms, r + 1, rounds);
+    }
+    fprintf(stderr, "\n");
+}
+
+static int compare_unsigned(const void *a, const void *b) {
+    unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of n sorted samples
+static unsigned percentile(const unsigned *v, int n, double p) {
+    int rank = (int)(p / 100 * n + 0.999999);
+    return v[rank < 1 ? 0 : rank - 1];
+}
+
+static void report_stats(FILE *f, unsigned *v, int n, int crossings, int lost) {
+    double sum = 0;
+
+    fprintf(f, "{ \"crossings\": %d, \"samples\": %d, \"lost\": %d", crossings, n, lost);
+    if (n > 0) {
+        qsort(v, n, sizeof(v[0]), compare_unsigned);
+        for (int i = 0; i < n; i++) sum += v[i];
+        fprintf(f, ", \"min\": %u, \"p50\": %u, \"p90\": %u, \"p95\": %u, \"p99\": %u, \"max\": %u, \"mean\": %.0f",
+                v[0], percentile(v, n, 50), percentile(v, n, 90), percentile(v, n, 95), percentile(v, n, 99),
+                v[n - 1], sum / n);
+    }
+    fprintf(f, " }");
+}
+
+static void report(FILE *f, const char *label, const char *device, int rounds, int scan_ms, uint32_t seed,
+                   const int th[3], Case *cases, int ncases) {
+    fprintf(f, "{\n  \"label\": \"%s\",\n  \"device\": \"%s\",\n  \"unit\": \"us\",\n", label, device);
+    fprintf(f, "  \"rounds\": %d,\n  \"scan_ms\": %d,\n  \"seed\": %u,\n", rounds, scan_ms, seed);
+    fprintf(f, "  \"thresholds\": { \"heater\": %d, \"sprinkler\": %d, \"light\": %d },\n", th[0], th[1], th[2]);
+    fprintf(f, "  \"cases\": [\n");
+    for (int k = 0; k < ncases; k++) {
+        Case *c = &cases[k];
+        unsigned *all = malloc(3 * MAX_ROUNDS * sizeof(unsigned));
+        int n = 0, crossings = 0, lost = 0;
+
+        fprintf(f, "    {\n      \"ui_hz\": %d,\n      \"telemetry_ms\": %d,\n      \"stray\": %d,\n",
+                c->ui_hz, c->telemetry_ms, c->stray);
+        for (int i = 0; i < 3; i++) {
+            fprintf(f, "      \"%s\": ", names[i]);
+            if (crossable & (1 << i)) {
+                memcpy(all + n, c->us[i], c->n[i] * sizeof(unsigned));
+                n += c->n[i];
+                crossings += c->crossings[i];
+                lost += c->lost[i];
+                report_stats(f, c->us[i], c->n[i], c->crossings[i], c->lost[i]);
+            } else {
+                fprintf(f, "{ \"skipped\": \"threshold %d cannot be crossed\" }", th[i]);
+            }
+            fprintf(f, ",\n");
+        }
+        fprintf(f, "      \"all\": ");
+        report_stats(f, all, n, crossings, lost);
+        fprintf(f, "\n    }%s\n", k + 1 < ncases ? "," : "");
+        free(all);
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+// Parses "a,b,c" into at most MAX_LOADS values, returns how many
+static int parse_list(const char *arg, int *v) {
+    int n = 0;
+    char *end;
+
+    while (n < MAX_LOADS) {
+        v[n++] = strtol(arg, &end, 10);
+        if (*end != ',') break;
+        arg = end + 1;
+    }
+    return n;
+}
+
+int main(int argc, char **argv) {
+    int rounds = 60, scan_ms = 1000, ui[MAX_LOADS] = { 0 }, tel[MAX_LOADS] = { 0 }, nui = 1, ntel = 1;
+    int th[3], auto_mode, ncases = 0;
+    uint32_t seed = 1;
+    const char *label = "", *path = NULL;
+    char sub[32];
+    FILE *f = stdout;
+    Case cases[MAX_LOADS * MAX_LOADS];
+    Serial s;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:u:t:s:r:l:o:")) != -1) {
+        switch (opt) {
+            case 'n': rounds = atoi(optarg); break;
+            case 'u': nui = parse_list(optarg, ui); break;
+            case 't': ntel = parse_list(optarg, tel); break;
+            case 's': scan_ms = atoi(optarg); break;
+            case 'r': seed = strtoul(optarg, NULL, 0); break;
+            case 'l': label = optarg; break;
+            case 'o': path = optarg; break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if (optind != argc - 1 || rounds < 1 || rounds > MAX_ROUNDS || scan_ms < 100) {
+        fprintf(stderr, "usage: %s [-n rounds] [-u hz,...] [-t ms,...] [-s scan ms] [-r seed] [-l label] "
+                        "[-o report.json] <device>\n", argv[0]);
+        return 2;
+    }
+    rng = seed ? seed : 1;
+    if (serial_open(&s, argv[optind]) != 0) return 1;
+
+    for (int i = 0; i < 3; i++) {
+        if (get_param(&s, thresholds[i], &th[i]) != 0) {
+            fprintf(stderr, "%s: no reply to GET:%s\n", argv[optind], thresholds[i]);
+            return 1;
+        }
+    }
+    if (get_param(&s, "AUTO", &auto_mode) != 0 || !auto_mode) {
+        fprintf(stderr, "the board must be in auto mode (SET:AUTO:1)\n");
+        return 1;
+    }
+    plan_readings(th);
+    if (crossable == 0) {
+        fprintf(stderr, "no threshold can be crossed by a sensor reading\n");
+        return 1;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (!(crossable & (1 << i))) fprintf(stderr, "%s skipped, %s is %d\n", names[i], thresholds[i], th[i]);
+    }
+    snprintf(sub, sizeof(sub), "SUB:LAT:%d", LAT_PERIOD_MS);
+    if (!command(&s, sub, NULL, 0) || !command(&s, "SET:KEY_TEST:0", NULL, 0)) {
+        fprintf(stderr, "the firmware has no latency probe (LAT stream, KEY_TEST)\n");
+        return 1;
+    }
+    command(&s, "SET:REPLAY:1", NULL, 0);
+
+    signal(SIGINT, on_signal);
+    for (int u = 0; u < nui; u++) {
+        for (int t = 0; t < ntel && !stop; t++) {
+            Case *c = &cases[ncases++];
+            memset(c, 0, sizeof(*c));
+            c->ui_hz = ui[u];
+            c->telemetry_ms = tel[t];
+            for (int i = 0; i < 3; i++) c->us[i] = malloc(MAX_ROUNDS * sizeof(unsigned));
+            run_case(&s, c, rounds, scan_ms);
+        }
+    }
+
+    // Leave the board as it runs normally
+    command(&s, "SET:REPLAY:0", NULL, 0);
+    command(&s, "SET:KEY_TEST:0", NULL, 0);
+    command(&s, "UNSUB:LAT", NULL, 0);
+    for (int i = 0; i < TELEMETRY; i++) {
+        char cmd[32];
+        snprintf(cmd, sizeof(cmd), "UNSUB:%s", telemetry[i]);
+        command(&s, cmd, NULL, 0);
+    }
+
+    if (path != NULL && (f = fopen(path, "w")) == NULL) {
+        perror(path);
+        return 1;
+    }
+    report(f, label, argv[optind], rounds, scan_ms, seed, th, cases, ncases);
+    if (f != stdout) fclose(f);
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Host benchmark of the hal.h calls Sensor_Thread and UART_Thread make, in
+// the order main.c makes them. Built as hal_bench against the static inline
+// HAL the firmware uses, and as hal_bench_calls with HAL_HOST_OUT_OF_LINE,
+// where each of those calls is a real function call; run both and compare.
+//
+//   gcc -O2 -DHAL_HOST -I../.. -I. hal_bench.c hal_host.c ../../fmt.c -o hal_bench
+//   gcc -O2 -DHAL_HOST -DHAL_HOST_OUT_OF_LINE -I../.. -I. hal_bench.c hal_host.c ../../fmt.c -o hal_bench_calls
+
+#include <stdio.h>
+#include "hal.h"
+#include "fmt.h"
+
+#define SCANS 20000000
+#define LINES 2000000
+
+// As in main.c
+volatile int temp_adc, moist_adc, light_adc;
+volatile int threadHoldtemp_adc = 1600;
+volatile int threadHoldmoist_adc = 5000;
+volatile int threadHoldlight_adc = 4091;
+static uint32_t cross_cycles[3];
+static uint32_t actuator_ons[3];
+
+void UART0_SendString(const char *str) {
+    while (*str) hal_uart_putc(HAL_UART_CONSOLE, *str++);
+}
+
+int actuator_is_on(int actuator) {
+    return actuator >= HAL_HEATER && actuator <= HAL_LIGHT ? hal_out_get(actuator) : 0;
+}
+
+// One Sensor_Thread scan: the three conversions, lat_scan()'s timestamp and
+// the actuator states for the scan record, then the switching the control
+// threads do through actuator_set() when a threshold is crossed
+static void sensor_scan(void) {
+    static uint32_t ons[3];
+    int act = 0;
+
+    temp_adc = hal_adc_read(0);
+    moist_adc = hal_adc_read(1);
+    light_adc = hal_adc_read(2);
+    cross_cycles[0] = hal_cycles();
+    for (int i = 0; i < 3; i++) {
+        if (actuator_ons[i] != ons[i] || actuator_is_on(i)) act |= 1 << i;
+        ons[i] = actuator_ons[i];
+    }
+    hal_out_set(HAL_HEATER, temp_adc >= threadHoldtemp_adc);
+    hal_out_set(HAL_SPRINKLER, moist_adc <= threadHoldmoist_adc);
+    hal_out_set(HAL_LIGHT, light_adc <= threadHoldlight_adc);
+    hal_out_set(HAL_STATUS_LED, act != 0);
+}
+
+static double time_scans(void) {
+    uint64_t t0 = hal_host_ns();
+
+    for (int i = 0; i < SCANS; i++) {
+        hal_host.adc[0] = (i >> 4) & 0xFFF; // Heater crosses its threshold now and then
+        sensor_scan();
+    }
+    return (double)(hal_host_ns() - t0) / SCANS;
+}
+
+// UART_Thread sending a RAW line, formatted once as stream_raw() does. The
+// host FIFO is emptied every 64 lines, well before it would drop bytes.
+static double time_lines(int *len) {
+    char line[64], drain[HAL_HOST_UART_BUF];
+    FmtBuf out;
+    uint64_t t0;
+
+    fmt_init(&out, line, sizeof(line));
+    fmt_str(&out, "TEMP:");
+    fmt_int(&out, 1650);
+    fmt_str(&out, "|MOIST:");
+    fmt_int(&out, 1800);
+    fmt_str(&out, "|LIGHT:");
+    fmt_int(&out, 3000);
+    fmt_char(&out, '\n');
+    *len = out.len;
+
+    t0 = hal_host_ns();
+    for (int i = 0; i < LINES; i++) {
+        UART0_SendString(line);
+        if ((i & 63) == 63) hal_host_uart_take(HAL_UART_CONSOLE, drain, sizeof(drain));
+    }
+    return (double)(hal_host_ns() - t0) / LINES;
+}
+
+int main(void) {
+    double scan, line;
+    int len;
+
+    hal_time_init();
+    hal_gpio_init();
+    hal_adc_init();
+    hal_uart_init(HAL_UART_CONSOLE);
+    hal_host.adc[1] = 1800;
+    hal_host.adc[2] = 3000;
+
+#ifdef HAL_HOST_OUT_OF_LINE
+    printf("HAL out of line\n");
+#else
+    printf("HAL static inline\n");
+#endif
+    scan = time_scans();
+    line = time_lines(&len);
+    printf("Sensor_Thread scan, 3 ADC, cycles, 3 get, 4 set  %6.2f ns\n", scan);
+    printf("UART_Thread RAW line, %d bytes                  %6.2f ns  %.2f ns/byte\n", len, line, line / len);
+    printf("%u ADC reads, %u output writes, %u heater switches\n",
+           hal_host.adc_reads, hal_host.output_writes, hal_host.switches[HAL_HEATER]);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include <time.h>
+#include "hal.h"
+
+HalHost hal_host;
+
+uint64_t hal_host_ns(void) {
+    struct timespec ts;
+    if (hal_host.virtual_time) return hal_host.virtual_ns;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void hal_host_out_changed(int out, int on) {
+    uint64_t now = hal_host_ns();
+    if (on) hal_host.on_since_ns[out] = now;
+    else hal_host.on_ns[out] += now - hal_host.on_since_ns[out];
+    hal_host.switches[out]++;
+}
+
+uint64_t hal_host_on_ns(int out) {
+    uint64_t ns = hal_host.on_ns[out];
+    if (hal_host.outputs & (1u << out)) ns += hal_host_ns() - hal_host.on_since_ns[out];
+    return ns;
+}
+
+void hal_host_uart_feed(int port, const char *data, int len) {
+    HalHostFifo *f = &hal_host.rx[port];
+    for (int i = 0; i < len; i++) {
+        if (f->head - __atomic_load_n(&f->tail, __ATOMIC_ACQUIRE) == HAL_HOST_UART_BUF) { // The FIFO on the part would overrun too
+            hal_host.uart_error[port] = 1;
+            return;
+        }
+        f->data[f->head % HAL_HOST_UART_BUF] = data[i];
+        __atomic_store_n(&f->head, f->head + 1, __ATOMIC_RELEASE);
+    }
+}
+
+int hal_host_uart_take(int port, char *out, int max) {
+    HalHostFifo *f = &hal_host.tx[port];
+    uint32_t head = __atomic_load_n(&f->head, __ATOMIC_ACQUIRE);
+    int n = 0;
+    while (n < max && f->tail + n != head) {
+        out[n] = f->data[(f->tail + n) % HAL_HOST_UART_BUF];
+        n++;
+    }
+    __atomic_store_n(&f->tail, f->tail + n, __ATOMIC_RELEASE);
+    return n;
+}
@@ -0,0 +1,166 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <stdint.h>
+
+// Linux implementation of hal.h, selected with -DHAL_HOST -I<repo>/host/hal.
+// The hardware is the hal_host structure: a simulation or benchmark sets the
+// ADC inputs and keys and queues received bytes, and reads back the outputs,
+// the bytes sent and what was drawn. The UART FIFOs may be filled and
+// drained from another thread than the firmware's, one on each side. Time
+// is the monotonic clock, counted in cycles of a 100 MHz core like the
+// LPC1768's. The display keeps no pixels, it counts the work it is given.
+
+#define HAL_HOST_HZ 100000000
+#define HAL_HOST_UART_BUF 4096      // Per direction and port, a power of two
+
+typedef struct {
+    char data[HAL_HOST_UART_BUF];
+    uint32_t head, tail;            // Free running, head - tail bytes queued; each side
+                                    // publishes its own index with release order
+} HalHostFifo;
+
+typedef struct {
+    int adc[3];                     // Inputs returned by hal_adc_read()
+    uint32_t adc_reads;
+    uint32_t outputs;               // One bit per HAL_ output
+    uint32_t output_writes;
+    uint64_t on_ns[HAL_OUTPUTS];    // Time each output was on, up to its last switch
+    uint64_t on_since_ns[HAL_OUTPUTS];
+    uint32_t switches[HAL_OUTPUTS]; // Times each output changed
+    uint32_t keys;                  // KEY_ bits held down
+    HalHostFifo rx[2], tx[2];       // Per HAL_UART_ port; tx drops what does not fit
+    int uart_error[2];              // Reported once by hal_uart_errors()
+    int display_level;              // HAL_DISPLAY_OFF ...
+    uint32_t display_chars;
+    uint64_t display_pixels;        // Pixels sent by all display calls
+    uint64_t start_ns;              // Time at hal_time_init()
+    int virtual_time;               // hal_host_ns() is virtual_ns, not the monotonic clock
+    uint64_t virtual_ns;
+} HalHost;
+
+extern HalHost hal_host;
+
+uint64_t hal_host_ns(void);                                  // Monotonic or virtual clock
+void hal_host_out_changed(int out, int on);                  // From hal_out_set() on a change
+uint64_t hal_host_on_ns(int out);                            // Time on so far
+void hal_host_uart_feed(int port, const char *data, int len); // Queued for hal_uart_getc()
+int hal_host_uart_take(int port, char *out, int max);         // Bytes sent, oldest first
+
+// The calls are static inline like the firmware's. HAL_HOST_OUT_OF_LINE makes
+// each one a real call the compiler knows nothing about at the call site, as
+// for a HAL in its own translation unit, so hal_bench can measure the
+// difference.
+#ifdef HAL_HOST_OUT_OF_LINE
+#define HAL_HOST_FN static __attribute__((noipa, unused))
+#else
+#define HAL_HOST_FN static inline
+#endif
+
+HAL_HOST_FN void hal_adc_init(void) {
+}
+
+HAL_HOST_FN int hal_adc_read(int channel) {
+    hal_host.adc_reads++;
+    return hal_host.adc[channel] & 0xFFF;
+}
+
+HAL_HOST_FN void hal_gpio_init(void) {
+    hal_host.outputs = 0;
+}
+
+HAL_HOST_FN int hal_out_get(int out) {
+    return (hal_host.outputs >> out) & 1;
+}
+
+HAL_HOST_FN void hal_out_set(int out, int on) {
+    uint32_t was = hal_host.outputs;
+    if (on) hal_host.outputs |= 1u << out; else hal_host.outputs &= ~(1u << out);
+    hal_host.output_writes++;
+    if (hal_host.outputs != was) hal_host_out_changed(out, on);
+}
+
+HAL_HOST_FN void hal_keys_init(void) {
+}
+
+HAL_HOST_FN uint32_t hal_keys(void) {
+    return hal_host.keys;
+}
+
+HAL_HOST_FN void hal_uart_init(int port) {
+    hal_host.rx[port].head = hal_host.rx[port].tail = 0;
+    hal_host.tx[port].head = hal_host.tx[port].tail = 0;
+}
+
+HAL_HOST_FN void hal_uart_putc(int port, char c) {
+    HalHostFifo *f = &hal_host.tx[port];
+    if (f->head - __atomic_load_n(&f->tail, __ATOMIC_ACQUIRE) < HAL_HOST_UART_BUF) {
+        f->data[f->head % HAL_HOST_UART_BUF] = c;
+        __atomic_store_n(&f->head, f->head + 1, __ATOMIC_RELEASE);
+    }
+}
+
+HAL_HOST_FN int hal_uart_getc(int port) {
+    HalHostFifo *f = &hal_host.rx[port];
+    int c;
+    if (__atomic_load_n(&f->head, __ATOMIC_ACQUIRE) == f->tail) return -1;
+    c = (uint8_t)f->data[f->tail % HAL_HOST_UART_BUF];
+    __atomic_store_n(&f->tail, f->tail + 1, __ATOMIC_RELEASE);
+    return c;
+}
+
+HAL_HOST_FN int hal_uart_errors(int port) {
+    int e = hal_host.uart_error[port];
+    hal_host.uart_error[port] = 0;
+    return e;
+}
+
+HAL_HOST_FN void hal_time_init(void) {
+    hal_host.start_ns = hal_host_ns();
+}
+
+HAL_HOST_FN uint32_t hal_clock_hz(void) {
+    return HAL_HOST_HZ;
+}
+
+HAL_HOST_FN uint32_t hal_cycles(void) {
+    return (uint32_t)((hal_host_ns() - hal_host.start_ns) / (1000000000 / HAL_HOST_HZ));
+}
+
+HAL_HOST_FN uint32_t hal_us(void) {
+    return (uint32_t)((hal_host_ns() - hal_host.start_ns) / 1000);
+}
+
+HAL_HOST_FN void hal_display_init(void) {
+    hal_host.display_level = HAL_DISPLAY_ON;
+}
+
+HAL_HOST_FN void hal_display_char(int x, int y, char c, uint32_t fg, uint32_t bg) {
+    hal_host.display_chars++;
+    hal_host.display_pixels += 16 * 24;
+}
+
+HAL_HOST_FN void hal_display_fill(int x, int y, int w, int h, uint32_t color) {
+    hal_host.display_pixels += w * h;
+}
+
+HAL_HOST_FN void hal_display_blit(int x, int y, int w, int h, const uint16_t *pixels) {
+    hal_host.display_pixels += w * h;
+}
+
+HAL_HOST_FN void hal_display_line(int y, const char *text, uint32_t fg, uint32_t bg) {
+    hal_host.display_pixels += HAL_DISPLAY_WIDTH * 24;
+}
+
+HAL_HOST_FN void hal_display_wait(void) {
+}
+
+HAL_HOST_FN void hal_display_power(int level) {
+    hal_host.display_level = level;
+}
+
+HAL_HOST_FN uint32_t hal_display_cache_pct(void) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,128 @@
+// Host benchmark of sample_log.c on the simulated NOR flash: bytes of flash
+// per sample, host time per append, modelled device time per sample and seek
+// time, for a few synthetic sensor traces. Every trace runs several laps
+// around the ring and the retained samples are read back and compared with
+// the trace, before and after a simulated reset.
+//
+//   gcc -O2 -I../.. log_bench.c nor_sim.c ../../sample_log.c -lm -o log_bench && ./log_bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "nor_sim.h"
+
+#define SECTORS 4               // Same layout as the firmware, sectors 24-27
+#define SECTOR_SIZE 0x8000
+#define SAMPLES 200000          // About 69 days at 30 s
+#define PERIOD_S 30
+#define SEEKS 20000
+
+enum { TRACE_GREENHOUSE, TRACE_JITTER, TRACE_NOISE, TRACE_COUNT };
+
+static const char *const trace_names[TRACE_COUNT] = { "greenhouse", "jitter", "noise" };
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint32_t hash(uint32_t x) {
+    x ^= x >> 16; x *= 0x7FEB352D;
+    x ^= x >> 15; x *= 0x846CA68B;
+    return x ^ (x >> 16);
+}
+
+static int noise(uint32_t i, int ch, int amp) {
+    return (int)(hash(i * 3 + ch) % (2 * amp + 1)) - amp;
+}
+
+static int clamp12(int v) {
+    return v < 0 ? 0 : v > 4095 ? 4095 : v;
+}
+
+// Sample i of a trace, the same every time it is asked for
+static void trace(int kind, uint32_t i, SlogSample *s) {
+    double day = 2 * M_PI * (i * PERIOD_S % 86400) / 86400.0;
+
+    s->time_s = i * PERIOD_S + (kind == TRACE_JITTER ? noise(i, 3, 2) + 2 : 0);
+    if (kind == TRACE_NOISE) {
+        for (int ch = 0; ch < SLOG_CHANNELS; ch++) s->value[ch] = hash(i * 3 + ch) & 0xFFF;
+        return;
+    }
+    s->value[0] = clamp12(1600 + (int)(400 * sin(day)) + noise(i, 0, 3));
+    s->value[1] = clamp12(3000 - (int)(i % 480) * 3 + noise(i, 1, 4));     // Dries out, watered every 4 h
+    s->value[2] = clamp12(sin(day) > 0 ? (int)(3000 * sin(day)) + noise(i, 2, 20) : noise(i, 2, 2) + 2);
+}
+
+static int same(const SlogSample *a, const SlogSample *b) {
+    if (a->time_s != b->time_s) return 0;
+    for (int ch = 0; ch < SLOG_CHANNELS; ch++) if (a->value[ch] != b->value[ch]) return 0;
+    return 1;
+}
+
+// Reads the whole log back and checks it is the end of the trace, up to 'last'
+static int verify(int kind, uint32_t last, uint32_t *retained) {
+    SlogCursor c;
+    SlogSample s, want;
+    uint32_t n = 0, i = 0;
+
+    slog_seek(&c, 0);
+    while (slog_read(&c, &s, 1) == 1) {
+        if (n == 0) { // Find where the retained part starts
+            while (i <= last) { trace(kind, i, &want); if (want.time_s >= s.time_s) break; i++; }
+        }
+        trace(kind, i++, &want);
+        if (!same(&s, &want)) return 0;
+        n++;
+    }
+    *retained = n;
+    return i == last + 1;
+}
+
+int main(void) {
+    printf("trace       bytes/sample  days@30s  append ns mean/max   device us/sample  seek us  erases/sector  ok\n");
+    for (int kind = 0; kind < TRACE_COUNT; kind++) {
+        const SlogFlash *flash = nor_sim_open(SECTORS, SECTOR_SIZE);
+        NorStats st;
+        SlogSample s;
+        SlogCursor c;
+        double t0, t1, worst = 0, total = 0, seek_ns;
+        uint32_t retained, remounted, flushed = 0;
+        int ok;
+
+        slog_init(flash);
+        for (uint32_t i = 0; i < SAMPLES; i++) {
+            trace(kind, i, &s);
+            t0 = now_ns();
+            slog_append(&s);
+            t1 = now_ns();
+            total += t1 - t0;
+            if (t1 - t0 > worst) worst = t1 - t0;
+        }
+        nor_sim_stats(&st);
+        ok = verify(kind, SAMPLES - 1, &retained) && st.overwrites == 0;
+
+        t0 = now_ns();
+        for (int i = 0; i < SEEKS; i++) {
+            uint32_t target = (SAMPLES - retained + hash(i) % retained) * PERIOD_S;
+            slog_seek(&c, target);
+            if (slog_read(&c, &s, 1) != 1 || s.time_s < target || c.prev.time_s != s.time_s) ok = 0;
+        }
+        seek_ns = (now_ns() - t0) / SEEKS;
+
+        // A reset loses the RAM block; what reached the flash must still read back
+        slog_init(flash);
+        slog_seek(&c, 0xFFFFFFFF);
+        while (flushed < SAMPLES) { trace(kind, flushed, &s); if (same(&s, &c.prev)) break; flushed++; }
+        if (flushed == SAMPLES || !verify(kind, flushed, &remounted)) ok = 0;
+
+        printf("%-10s  %12.2f  %8.1f  %9.0f / %-8.0f  %16.1f  %7.2f  %13u  %s\n",
+               trace_names[kind], (double)st.programs * SLOG_PAGE / SAMPLES,
+               (double)retained * PERIOD_S / 86400, total / SAMPLES, worst,
+               (double)st.busy_us / SAMPLES, seek_ns / 1000, st.max_sector_erases, ok ? "yes" : "NO");
+    }
+    printf("raw samples take %d bytes\n", (int)sizeof(SlogSample));
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdlib.h>
+#include <string.h>
+#include "nor_sim.h"
+
+static uint8_t *mem;
+static uint32_t *sector_erases;
+static SlogFlash dev;
+static NorStats stats;
+
+static int nor_erase(int sector) {
+    if (sector < 0 || sector >= dev.sectors) return -1;
+    memset(mem + sector * dev.sector_size, 0xFF, dev.sector_size);
+    stats.erases++;
+    if (++sector_erases[sector] > stats.max_sector_erases) stats.max_sector_erases = sector_erases[sector];
+    stats.busy_us += NOR_ERASE_US;
+    return 0;
+}
+
+static int nor_program(int page, const void *data) {
+    uint8_t *p = mem + page * SLOG_PAGE;
+    const uint8_t *src = data;
+    int blank = 1;
+
+    if (page < 0 || page >= dev.sectors * dev.sector_size / SLOG_PAGE) return -1;
+    for (int i = 0; i < SLOG_PAGE; i++) {
+        if (p[i] != 0xFF) blank = 0;
+        p[i] &= src[i]; // Bits only go from 1 to 0
+    }
+    if (!blank) stats.overwrites++;
+    stats.programs++;
+    stats.busy_us += NOR_PROGRAM_US;
+    return 0;
+}
+
+const SlogFlash *nor_sim_open(int sectors, int sector_size) {
+    free(mem);
+    free(sector_erases);
+    mem = malloc(sectors * sector_size);
+    sector_erases = calloc(sectors, sizeof(*sector_erases));
+    memset(mem, 0xFF, sectors * sector_size);
+    memset(&stats, 0, sizeof(stats));
+    dev.mem = mem;
+    dev.sectors = sectors;
+    dev.sector_size = sector_size;
+    dev.erase = nor_erase;
+    dev.program = nor_program;
+    return &dev;
+}
+
+void nor_sim_stats(NorStats *out) {
+    *out = stats;
+}
@@ -0,0 +1,27 @@
+#ifndef NOR_SIM_H
+#define NOR_SIM_H
+
+#include <stdint.h>
+#include "sample_log.h"
+
+// Simulated NOR flash for running sample_log on Linux. Like the LPC1768
+// flash, an erase sets a whole sector to 0xFF and programming can only clear
+// bits. Programming a page that is not blank is counted as an error, since on
+// the real part it corrupts the ECC. Device time is modelled with the
+// datasheet figures instead of being waited for.
+
+#define NOR_PROGRAM_US 1000     // One 256-byte page
+#define NOR_ERASE_US 100000     // One sector
+
+typedef struct {
+    uint32_t programs;
+    uint32_t erases;
+    uint32_t overwrites;        // Pages programmed twice without an erase
+    uint32_t max_sector_erases; // Wear of the most erased sector
+    uint64_t busy_us;           // Modelled device time
+} NorStats;
+
+const SlogFlash *nor_sim_open(int sectors, int sector_size); // Fresh, erased device
+void nor_sim_stats(NorStats *out);
+
+#endif
@@ -0,0 +1,100 @@
+#include <string.h>
+#include "bus_sched.h"
+#include "rs485_proto.h"
+
+void bus_default_config(BusConfig *cfg, int baud) {
+    uint32_t char_us = 10000000u / baud;
+    cfg->baud = baud;
+    cfg->guard_us = 3 * char_us;
+    cfg->min_timeout_us = 5000;
+    cfg->max_timeout_us = 20000 + RS485_MAX_FRAME * char_us;
+    cfg->max_skip = 64;
+}
+
+static uint32_t frame_us(const BusConfig *cfg) {
+    return RS485_MAX_FRAME * (10000000u / cfg->baud);
+}
+
+void bus_init(BusNode *nodes, int count, int first_addr) {
+    memset(nodes, 0, count * sizeof(BusNode));
+    for (int i = 0; i < count; i++) nodes[i].addr = first_addr + i;
+}
+
+// Time allowed for the first frame of an answer to arrive
+static uint32_t node_timeout(const BusConfig *cfg, const BusNode *n) {
+    uint32_t t = n->rtt_us ? 2 * n->rtt_us : cfg->max_timeout_us;
+    if (t < cfg->min_timeout_us) t = cfg->min_timeout_us;
+    if (t > cfg->max_timeout_us) t = cfg->max_timeout_us;
+    return t;
+}
+
+// Reads and drops lines until nothing arrives for the given window
+static void drain(const BusTransport *t, uint32_t window_us) {
+    char line[RS485_MAX_FRAME];
+    while (t->recv_line(t->ctx, line, sizeof(line), t->now_us(t->ctx) + window_us) >= 0) {
+    }
+}
+
+static void node_missed(const BusConfig *cfg, BusNode *n) {
+    n->timeouts++;
+    n->misses++;
+    n->skip = 0;
+    if (n->misses >= 2) {
+        n->skip = 1 << (n->misses - 1 < 16 ? n->misses - 1 : 16);
+        if (n->skip > cfg->max_skip) n->skip = cfg->max_skip;
+    }
+}
+
+int bus_cycle(const BusTransport *t, const BusConfig *cfg, BusNode *nodes, int count,
+              const char *request, BusLineFn on_line, void *user) {
+    char frame[RS485_MAX_FRAME];
+    char line[RS485_MAX_FRAME];
+    int answered = 0;
+
+    for (int i = 0; i < count; i++) {
+        BusNode *n = &nodes[i];
+        uint64_t sent, deadline;
+        int len, done = 0;
+
+        if (n->skip > 0) {
+            n->skip--;
+            continue;
+        }
+        len = rs485_frame(frame, sizeof(frame), RS485_REQUEST, n->addr, request);
+        if (!len) return answered;
+
+        t->send(t->ctx, frame, len);
+        n->polls++;
+        sent = t->now_us(t->ctx);
+        deadline = sent + node_timeout(cfg, n);
+
+        while (!done) {
+            int addr;
+            char *payload;
+            if (t->recv_line(t->ctx, line, sizeof(line), deadline) < 0) break;
+            if (!rs485_parse(line, RS485_RESPONSE, &addr, &payload) || addr != n->addr) {
+                n->bad_frames++;
+                continue;
+            }
+            deadline = t->now_us(t->ctx) + frame_us(cfg) + cfg->guard_us; // Answer is flowing, allow the next frame
+            if (strcmp(payload, "END") == 0) {
+                done = 1;
+            } else if (on_line) {
+                on_line(addr, payload, user);
+            }
+        }
+
+        if (done) {
+            uint32_t rtt = (uint32_t)(t->now_us(t->ctx) - sent);
+            n->rtt_us = n->rtt_us ? n->rtt_us - n->rtt_us / 8 + rtt / 8 : rtt;
+            n->answers++;
+            n->misses = 0;
+            answered++;
+            drain(t, cfg->guard_us); // Let the node release DE
+        } else {
+            node_missed(cfg, n);
+            drain(t, cfg->guard_us + frame_us(cfg)); // A late answer must end before the next request
+        }
+    }
+    return answered;
+}
@@ -0,0 +1,48 @@
+#ifndef BUS_SCHED_H
+#define BUS_SCHED_H
+
+#include <stdint.h>
+
+// Host side scheduler for the multi-drop RS-485 bus. The bus is half duplex
+// and only the host starts a transfer, so throughput is bounded by how little
+// time is spent waiting: per-node timeouts follow each node's measured answer
+// time, nodes that stop answering are polled less and less often, and after a
+// timeout the bus is drained until it is quiet before the next request goes
+// out, so a late answer never collides with the next poll.
+
+typedef struct {
+    void *ctx;
+    uint64_t (*now_us)(void *ctx);
+    int (*send)(void *ctx, const char *data, int len);
+    // Reads one line without '\n', waiting until deadline_us. Returns its
+    // length, or -1 if nothing complete arrived by then.
+    int (*recv_line)(void *ctx, char *line, int size, uint64_t deadline_us);
+} BusTransport;
+
+typedef struct {
+    int baud;
+    uint32_t guard_us;          // Quiet time required before sending
+    uint32_t min_timeout_us;    // Bounds for the adaptive answer timeout
+    uint32_t max_timeout_us;
+    int max_skip;               // Longest back-off in cycles for silent nodes
+} BusConfig;
+
+typedef struct {
+    int addr;
+    uint32_t rtt_us;            // Smoothed request end to END frame time, 0 until known
+    int misses;                 // Consecutive unanswered polls
+    int skip;                   // Cycles left before the next poll
+    uint32_t polls, answers, timeouts, bad_frames;
+} BusNode;
+
+typedef void (*BusLineFn)(int addr, const char *payload, void *user);
+
+void bus_default_config(BusConfig *cfg, int baud);
+void bus_init(BusNode *nodes, int count, int first_addr);
+
+// Sends request to every node that is due and collects the answers.
+// Returns the number of nodes that answered with an END frame.
+int bus_cycle(const BusTransport *t, const BusConfig *cfg, BusNode *nodes, int count,
+              const char *request, BusLineFn on_line, void *user);
+
+#endif
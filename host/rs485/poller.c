@@ -0,0 +1,118 @@
+// Polls a range of RS-485 controller nodes through a USB-RS485 adapter and
+// prints every telemetry line as "<addr> <line>". Adapters must switch their
+// driver automatically (most FTDI/CH340 based ones do).
+//
+//   gcc -O2 -I../.. poller.c bus_sched.c ../../rs485_proto.c ../../fmt.c -o poller
+//   ./poller /dev/ttyUSB0 <first addr> <last addr> [baud] [request]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/select.h>
+#include "bus_sched.h"
+#include "rs485_proto.h"
+
+typedef struct {
+    int fd;
+    char buf[RS485_MAX_FRAME * 2];
+    int len;
+} SerialPort;
+
+static uint64_t serial_now(void *ctx) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+static int serial_send(void *ctx, const char *data, int len) {
+    SerialPort *port = ctx;
+    int n = write(port->fd, data, len);
+    tcdrain(port->fd); // Returns once the last byte left the UART
+    return n;
+}
+
+static int serial_recv_line(void *ctx, char *line, int size, uint64_t deadline_us) {
+    SerialPort *port = ctx;
+    while (1) {
+        char *nl = memchr(port->buf, '\n', port->len);
+        if (nl) {
+            int n = nl - port->buf;
+            int copy = n < size - 1 ? n : size - 1;
+            memcpy(line, port->buf, copy);
+            line[copy] = '\0';
+            if (copy && line[copy - 1] == '\r') line[--copy] = '\0';
+            port->len -= n + 1;
+            memmove(port->buf, nl + 1, port->len);
+            return copy;
+        }
+        if (port->len == sizeof(port->buf)) port->len = 0; // Garbage without newline
+
+        uint64_t now = serial_now(ctx);
+        if (now >= deadline_us) return -1;
+        struct timeval tv = { (deadline_us - now) / 1000000, (deadline_us - now) % 1000000 };
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(port->fd, &fds);
+        if (select(port->fd + 1, &fds, NULL, NULL, &tv) <= 0) return -1;
+        int n = read(port->fd, port->buf + port->len, sizeof(port->buf) - port->len);
+        if (n > 0) port->len += n;
+    }
+}
+
+static speed_t baud_constant(int baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+    }
+    return 0;
+}
+
+static void print_line(int addr, const char *payload, void *user) {
+    printf("%d %s\n", addr, payload);
+}
+
+int main(int argc, char **argv) {
+    static BusNode nodes[RS485_MAX_ADDR];
+    SerialPort port = { 0 };
+    BusTransport t = { &port, serial_now, serial_send, serial_recv_line };
+    BusConfig cfg;
+    struct termios tio;
+
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <device> <first addr> <last addr> [baud] [request]\n", argv[0]);
+        return 2;
+    }
+    int first = atoi(argv[2]), last = atoi(argv[3]);
+    int baud = argc > 4 ? atoi(argv[4]) : 38400;
+    const char *request = argc > 5 ? argv[5] : "POLL";
+    if (first < 1 || last > RS485_MAX_ADDR || last < first || !baud_constant(baud)) {
+        fprintf(stderr, "bad address range or baud rate\n");
+        return 2;
+    }
+
+    port.fd = open(argv[1], O_RDWR | O_NOCTTY);
+    if (port.fd < 0 || tcgetattr(port.fd, &tio) < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud_constant(baud));
+    cfsetospeed(&tio, baud_constant(baud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(port.fd, TCSANOW, &tio);
+    tcflush(port.fd, TCIOFLUSH);
+
+    bus_default_config(&cfg, baud);
+    bus_init(nodes, last - first + 1, first);
+    while (1) {
+        bus_cycle(&t, &cfg, nodes, last - first + 1, request, print_line, NULL);
+        fflush(stdout);
+    }
+}
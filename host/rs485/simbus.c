@@ -0,0 +1,151 @@
+// Simulated RS-485 bus for testing the poll scheduler on Linux. Nodes answer
+// POLL like the firmware does, on a virtual clock where every byte costs ten
+// bit times, so no serial hardware or real waiting is needed. Some nodes are
+// absent, some answer slowly and some corrupt frames. Overlapping transmitters
+// are counted as collisions.
+//
+//   gcc -O2 -I../.. simbus.c bus_sched.c ../../rs485_proto.c ../../fmt.c -o simbus
+//   ./simbus [nodes] [cycles] [baud]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bus_sched.h"
+#include "rs485_proto.h"
+
+#define MAX_NODES 64
+#define MAX_PENDING 8
+
+typedef struct {
+    int addr;
+    int present;
+    uint32_t latency_us;        // Request end to first answer byte
+    int corrupt_every;          // Corrupt one frame in N, 0 for never
+    uint32_t answers;
+} SimNode;
+
+typedef struct {
+    char text[RS485_MAX_FRAME];
+    uint64_t start_us, end_us;  // Time on the wire
+} SimFrame;
+
+typedef struct {
+    uint64_t now;
+    uint32_t char_us;
+    SimNode nodes[MAX_NODES];
+    int node_count;
+    SimFrame pending[MAX_PENDING];
+    int pending_count;
+    uint64_t busy_until;        // End of the last node transmission
+    uint64_t busy_us;           // Total time the bus carried data
+    uint32_t collisions;
+    uint32_t lines;
+} SimBus;
+
+static uint64_t sim_now(void *ctx) {
+    return ((SimBus *)ctx)->now;
+}
+
+static void node_queue(SimBus *bus, SimNode *node, const char *payload, uint64_t *at) {
+    SimFrame *f = &bus->pending[bus->pending_count++];
+    int len = rs485_frame(f->text, sizeof(f->text), RS485_RESPONSE, node->addr, payload);
+    if (node->corrupt_every && ++node->answers % node->corrupt_every == 0) f->text[5] ^= 0x20;
+    f->start_us = *at;
+    f->end_us = *at + (uint64_t)len * bus->char_us;
+    *at = f->end_us;
+    bus->busy_us += f->end_us - f->start_us;
+    if (f->end_us > bus->busy_until) bus->busy_until = f->end_us;
+}
+
+static int sim_send(void *ctx, const char *data, int len) {
+    SimBus *bus = ctx;
+    char line[RS485_MAX_FRAME];
+    char *payload;
+    int addr;
+    uint64_t end = bus->now + (uint64_t)len * bus->char_us;
+
+    if (bus->busy_until > bus->now) bus->collisions++;
+    bus->busy_us += end - bus->now;
+    bus->now = end;
+
+    strncpy(line, data, sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+    line[strcspn(line, "\n")] = '\0';
+    if (!rs485_parse(line, RS485_REQUEST, &addr, &payload)) return len;
+
+    for (int i = 0; i < bus->node_count; i++) {
+        SimNode *node = &bus->nodes[i];
+        uint64_t at = end + node->latency_us;
+        if (!node->present || node->addr != addr || addr == RS485_BROADCAST) continue;
+        if (strcmp(payload, "POLL") == 0) {
+            char text[64];
+            snprintf(text, sizeof(text), "TEMP:%d|MOIST:%d|LIGHT:%d", 1500 + addr, 2000 + addr, 3000 + addr);
+            node_queue(bus, node, text, &at);
+            node_queue(bus, node, "ACT:HEATER:0|SPRINKLER:1|LIGHT:0|AUTO:1", &at);
+            node_queue(bus, node, "FAULT:00", &at);
+        }
+        node_queue(bus, node, "END", &at);
+    }
+    return len;
+}
+
+static int sim_recv_line(void *ctx, char *line, int size, uint64_t deadline_us) {
+    SimBus *bus = ctx;
+    if (bus->pending_count == 0 || bus->pending[0].end_us > deadline_us) {
+        if (deadline_us > bus->now) bus->now = deadline_us;
+        return -1;
+    }
+    SimFrame f = bus->pending[0];
+    memmove(&bus->pending[0], &bus->pending[1], (--bus->pending_count) * sizeof(SimFrame));
+    if (f.end_us > bus->now) bus->now = f.end_us;
+    strncpy(line, f.text, size - 1);
+    line[size - 1] = '\0';
+    line[strcspn(line, "\n")] = '\0';
+    bus->lines++;
+    return strlen(line);
+}
+
+static void count_line(int addr, const char *payload, void *user) {
+    (*(uint32_t *)user)++;
+}
+
+int main(int argc, char **argv) {
+    static SimBus bus;
+    BusNode nodes[MAX_NODES];
+    BusConfig cfg;
+    BusTransport t = { &bus, sim_now, sim_send, sim_recv_line };
+    int count = argc > 1 ? atoi(argv[1]) : 32;
+    int cycles = argc > 2 ? atoi(argv[2]) : 1000;
+    int baud = argc > 3 ? atoi(argv[3]) : 38400;
+    uint32_t data_lines = 0, polls = 0, answers = 0, timeouts = 0, bad = 0;
+
+    if (count < 1 || count > MAX_NODES) count = MAX_NODES;
+    bus.char_us = 10000000u / baud;
+    bus.node_count = count;
+    for (int i = 0; i < count; i++) {
+        bus.nodes[i].addr = i + 1;
+        bus.nodes[i].present = (i % 8) != 7;                    // Every eighth node is missing
+        bus.nodes[i].latency_us = 2000 + (i % 5) * 1000;        // Turnaround plus RX poll jitter
+        bus.nodes[i].corrupt_every = (i % 11 == 3) ? 50 : 0;    // A few noisy drops
+    }
+
+    bus_default_config(&cfg, baud);
+    bus_init(nodes, count, 1);
+    for (int c = 0; c < cycles; c++) {
+        bus_cycle(&t, &cfg, nodes, count, "POLL", count_line, &data_lines);
+    }
+
+    for (int i = 0; i < count; i++) {
+        polls += nodes[i].polls;
+        answers += nodes[i].answers;
+        timeouts += nodes[i].timeouts;
+        bad += nodes[i].bad_frames;
+    }
+    double secs = bus.now / 1e6;
+    printf("nodes %d, %d cycles at %d baud in %.1f simulated s\n", count, cycles, baud, secs);
+    printf("polls %u, answers %u, timeouts %u, bad frames %u, collisions %u\n",
+           polls, answers, timeouts, bad, bus.collisions);
+    printf("answers/s %.1f, data lines/s %.1f, bus utilisation %.1f%%\n",
+           answers / secs, data_lines / secs, 100.0 * bus.busy_us / bus.now);
+    return bus.collisions ? 1 : 0;
+}
@@ -0,0 +1,188 @@
+#ifndef CMSIS_OS_H
+#define CMSIS_OS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CMSIS-RTOS v1 API for the host simulation, implemented in os_sim.c on
+// one host thread. Only the calls the firmware makes are provided, with
+// the RTX 4 behaviour it relies on: one thread runs at a time, the highest
+// priority ready thread runs, equal priorities share the CPU in
+// OS_ROBINTOUT slices, mutexes are recursive with priority inheritance, and
+// timer callbacks run in a timer thread at osPriorityHigh. A thread only
+// gives the CPU up inside these calls, so code between two calls is never
+// interleaved with another thread, as with interrupts off on the target.
+// The kernel tick is 1 ms.
+
+#define osCMSIS 0x10002
+#define osCMSIS_RTX 0x40078
+#define osKernelSystemId "RTX V4.78 host"
+#define osFeature_Signals 16
+#define osFeature_SysTick 1
+
+typedef enum {
+    osOK = 0,
+    osEventSignal = 0x08,
+    osEventMessage = 0x10,
+    osEventMail = 0x20,
+    osEventTimeout = 0x40,
+    osErrorParameter = 0x80,
+    osErrorResource = 0x81,
+    osErrorTimeoutResource = 0xC1,
+    osErrorISR = 0x82,
+    osErrorPriority = 0x84,
+    osErrorNoMemory = 0x85,
+    osErrorValue = 0x86,
+    osErrorOS = 0xFF
+} osStatus;
+
+typedef enum {
+    osPriorityIdle = -3,
+    osPriorityLow = -2,
+    osPriorityBelowNormal = -1,
+    osPriorityNormal = 0,
+    osPriorityAboveNormal = 1,
+    osPriorityHigh = 2,
+    osPriorityRealtime = 3,
+    osPriorityError = 0x84
+} osPriority;
+
+typedef enum { osTimerOnce = 0, osTimerPeriodic = 1 } os_timer_type;
+
+#define osWaitForever 0xFFFFFFFF
+
+typedef void (*os_pthread)(void const *argument);
+typedef void (*os_ptimer)(void const *argument);
+
+typedef struct os_thread_cb *osThreadId;
+typedef struct os_timer_cb *osTimerId;
+typedef struct os_mutex_cb *osMutexId;
+typedef struct os_semaphore_cb *osSemaphoreId;
+typedef struct os_mailQ_cb *osMailQId;
+
+// Control blocks, defined here so the osXxxDef() macros can allocate them
+// statically as RTX does
+struct os_timer_cb {
+    os_ptimer ptimer;
+    void *argument;
+    int type;
+    int running;
+    uint32_t period_ms;
+    uint64_t due_ms;
+    struct os_timer_cb *next;   // All created timers
+};
+
+struct os_mutex_cb {
+    struct os_thread_cb *owner;
+    int count;                  // Nesting depth of the owner's waits
+};
+
+struct os_semaphore_cb {
+    int32_t tokens;
+};
+
+struct os_mailQ_cb {
+    uint32_t queue_sz, item_sz;
+    uint8_t *blocks;            // queue_sz blocks of item_sz bytes
+    uint8_t *in_use;
+    void **fifo;                // Put, not yet got
+    uint32_t head, count;
+};
+
+typedef struct {
+    os_pthread pthread;
+    osPriority tpriority;
+    uint32_t instances;
+    uint32_t stacksize;
+} osThreadDef_t;
+
+typedef struct { os_ptimer ptimer; struct os_timer_cb *timer; } osTimerDef_t;
+typedef struct { struct os_mutex_cb *mutex; } osMutexDef_t;
+typedef struct { struct os_semaphore_cb *semaphore; } osSemaphoreDef_t;
+typedef struct { uint32_t queue_sz; uint32_t item_sz; struct os_mailQ_cb *pool; } osMailQDef_t;
+
+typedef struct {
+    osStatus status;
+    union {
+        uint32_t v;
+        void *p;
+        int32_t signals;
+    } value;
+    union {
+        osMailQId mail_id;
+    } def;
+} osEvent;
+
+// Kernel. osKernelSysTick() counts core cycles of the simulated 100 MHz part.
+#define osKernelSysTickFrequency 100000000
+#define osKernelSysTickMicroSec(microsec) (((uint64_t)(microsec) * osKernelSysTickFrequency) / 1000000)
+
+osStatus osKernelInitialize(void);
+osStatus osKernelStart(void);
+int32_t osKernelRunning(void);
+uint32_t osKernelSysTick(void);
+
+// Threads
+#define osThreadDef(name, priority, instances, stacksz) \
+    const osThreadDef_t os_thread_def_##name = { (name), (priority), (instances), (stacksz) }
+#define osThread(name) &os_thread_def_##name
+
+osThreadId osThreadCreate(const osThreadDef_t *thread_def, void *argument);
+osThreadId osThreadGetId(void);
+osStatus osThreadTerminate(osThreadId thread_id);
+osStatus osThreadYield(void);
+osStatus osThreadSetPriority(osThreadId thread_id, osPriority priority);
+osPriority osThreadGetPriority(osThreadId thread_id);
+
+osStatus osDelay(uint32_t millisec);
+
+// Timers
+#define osTimerDef(name, function) \
+    struct os_timer_cb os_timer_cb_##name; \
+    const osTimerDef_t os_timer_def_##name = { (function), &os_timer_cb_##name }
+#define osTimer(name) &os_timer_def_##name
+
+osTimerId osTimerCreate(const osTimerDef_t *timer_def, os_timer_type type, void *argument);
+osStatus osTimerStart(osTimerId timer_id, uint32_t millisec);
+osStatus osTimerStop(osTimerId timer_id);
+
+// Signals
+int32_t osSignalSet(osThreadId thread_id, int32_t signals);
+int32_t osSignalClear(osThreadId thread_id, int32_t signals);
+osEvent osSignalWait(int32_t signals, uint32_t millisec);
+
+// Mutexes
+#define osMutexDef(name) \
+    struct os_mutex_cb os_mutex_cb_##name; \
+    const osMutexDef_t os_mutex_def_##name = { &os_mutex_cb_##name }
+#define osMutex(name) &os_mutex_def_##name
+
+osMutexId osMutexCreate(const osMutexDef_t *mutex_def);
+osStatus osMutexWait(osMutexId mutex_id, uint32_t millisec);
+osStatus osMutexRelease(osMutexId mutex_id);
+
+// Semaphores
+#define osSemaphoreDef(name) \
+    struct os_semaphore_cb os_semaphore_cb_##name; \
+    const osSemaphoreDef_t os_semaphore_def_##name = { &os_semaphore_cb_##name }
+#define osSemaphore(name) &os_semaphore_def_##name
+
+osSemaphoreId osSemaphoreCreate(const osSemaphoreDef_t *semaphore_def, int32_t count);
+int32_t osSemaphoreWait(osSemaphoreId semaphore_id, uint32_t millisec);
+osStatus osSemaphoreRelease(osSemaphoreId semaphore_id);
+
+// Mail queues. osMailAlloc() does not wait, whatever the timeout, as from
+// an interrupt on the target.
+#define osMailQDef(name, queue_sz, type) \
+    struct os_mailQ_cb os_mailQ_cb_##name; \
+    const osMailQDef_t os_mailQ_def_##name = { (queue_sz), sizeof(type), &os_mailQ_cb_##name }
+#define osMailQ(name) &os_mailQ_def_##name
+
+osMailQId osMailCreate(const osMailQDef_t *queue_def, osThreadId thread_id);
+void *osMailAlloc(osMailQId queue_id, uint32_t millisec);
+void *osMailCAlloc(osMailQId queue_id, uint32_t millisec);
+osStatus osMailPut(osMailQId queue_id, void *mail);
+osEvent osMailGet(osMailQId queue_id, uint32_t millisec);
+osStatus osMailFree(osMailQId queue_id, void *mail);
+
+#endif
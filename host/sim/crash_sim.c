@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "crash.h"
+
+// crash.h for the host simulation. Trace events go to the same ring as on
+// the target, stamped with hal_us(). Nothing is captured or kept in flash: a
+// fault in the simulation stops the process for the debugger instead.
+
+static CrashRecord record;
+
+void crash_init(void) {
+    record.trace_magic = 0;
+    record.trace_count = 0;
+    crash_trace(TRACE_BOOT, 0);
+}
+
+void crash_trace(int event, int arg) {
+    TraceEntry *e = &record.trace[record.trace_count++ % TRACE_LEN];
+    e->time_us = hal_us();
+    e->event = event;
+    e->arg = arg;
+}
+
+void crash_error(uint32_t code) {
+    fprintf(stderr, "RTX error %u\n", (unsigned)code);
+    abort();
+}
+
+int crash_count(void) {
+    return 0;
+}
+
+const CrashRecord *crash_get(int n) {
+    return NULL;
+}
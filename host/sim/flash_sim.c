@@ -0,0 +1,71 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "flash_iap.h"
+#include "crash.h"
+#include "flash_sim.h"
+
+#define SECTOR_SIZE 0x8000
+#define SIM_BASE 0x00010000         // Sector 16
+#define SIM_SIZE ((FLASH_SIM_LAST - FLASH_SIM_FIRST + 1) * SECTOR_SIZE)
+
+int flash_sim_open(const char *path) {
+    struct stat st;
+    int fd;
+    uint8_t *mem;
+
+    if (path == NULL) {
+        mem = mmap((void *)SIM_BASE, SIM_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (mem != (uint8_t *)SIM_BASE) {
+            fprintf(stderr, "flash: cannot map at 0x%x\n", SIM_BASE);
+            return -1;
+        }
+        memset(mem, 0xFF, SIM_SIZE);
+        return 0;
+    }
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        return -1;
+    }
+    if (st.st_size != SIM_SIZE && ftruncate(fd, SIM_SIZE) != 0) {
+        perror(path);
+        return -1;
+    }
+    mem = mmap((void *)SIM_BASE, SIM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    close(fd);
+    if (mem != (uint8_t *)SIM_BASE) {
+        fprintf(stderr, "%s: cannot map at 0x%x\n", path, SIM_BASE);
+        return -1;
+    }
+    if (st.st_size != SIM_SIZE) memset(mem, 0xFF, SIM_SIZE); // Blank part
+    return 0;
+}
+
+uint32_t flash_sector_addr(int sector) {
+    return sector < 16 ? sector * 0x1000 : 0x10000 + (sector - 16) * 0x8000;
+}
+
+int flash_erase(int sector) {
+    if (sector < FLASH_SIM_FIRST || sector > FLASH_SIM_LAST) return -1;
+    memset((void *)(uintptr_t)flash_sector_addr(sector), 0xFF, SECTOR_SIZE);
+    crash_trace(TRACE_FLASH, sector);
+    return 0;
+}
+
+int flash_program(uint32_t addr, const void *data, int len) {
+    uint8_t *dst = (uint8_t *)(uintptr_t)addr;
+    const uint8_t *src = data;
+
+    if (addr < SIM_BASE || addr + len > SIM_BASE + SIM_SIZE || addr % FLASH_PAGE != 0 ||
+        (len != 256 && len != 512 && len != 1024 && len != 4096))
+        return -1;
+    for (int i = 0; i < len; i++) dst[i] &= src[i]; // Bits only go from 1 to 0
+    crash_trace(TRACE_FLASH, 16 + (addr - 0x10000) / SECTOR_SIZE);
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef FLASH_SIM_H
+#define FLASH_SIM_H
+
+// flash_iap.h for the host simulation, in flash_sim.c. The 32 kB sectors
+// 16-29, which hold the crash records, the sample log and the settings, are
+// a file mapped at their addresses on the part: the firmware reads them
+// through the same pointers, and they survive restarts of the simulation.
+// As on the part, an erase sets a sector to 0xFF and programming can only
+// clear bits.
+
+#define FLASH_SIM_FIRST 16
+#define FLASH_SIM_LAST 29
+
+// Before the firmware starts, 0 on success. A new file is blank, and a NULL
+// path gives blank sectors in memory only.
+int flash_sim_open(const char *path);
+
+#endif
@@ -0,0 +1,541 @@
+#undef _FORTIFY_SOURCE // Its longjmp() refuses to change stacks
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include "cmsis_os.h"
+#include "hal.h"
+#include "os_sim.h"
+
+// Every firmware thread is a ucontext with its own stack, all on one host
+// thread, so only the one in 'current' runs. It gives the CPU up inside the
+// os calls below, each of which is a scheduling point. When no thread is
+// ready, the one giving the CPU up waits for the earliest timeout and counts
+// that time as idle, like os_idle_demon on the target: in real time it
+// sleeps, in virtual time the clock jumps straight there. With nothing else
+// deciding the order, a virtual time run is the same every time. A thread
+// starts on its ucontext; switches after that are _setjmp()/_longjmp(),
+// which unlike swapcontext() leave the signal mask alone and make no system
+// call, half the cost of a switch.
+
+#define SIM_THREADS 32
+#define SIM_STACK (256 * 1024)    // Host code needs more than the target's 1 kB
+#define ROBIN_MS 5                // OS_ROBINTOUT in RTX_Conf_CM.c
+#define FOREVER UINT64_MAX
+
+enum { T_FREE, T_READY, T_WAIT, T_DONE };
+enum { W_DELAY, W_SIGNAL, W_MUTEX, W_SEMAPHORE, W_MAIL, W_TIMER };
+
+struct os_thread_cb {
+    ucontext_t context;           // Entry, until started
+    jmp_buf jump;                 // Where it gave the CPU up, once started
+    int started;
+    os_pthread func;
+    void *argument;
+    int state;
+    int prio, base_prio;          // prio is raised while holding a mutex a higher thread wants
+    uint64_t ready_seq;           // Order among equal priorities, lowest runs first
+    int wait;                     // W_ while T_WAIT
+    void *object;
+    uint64_t wake_ms;             // Timeout, FOREVER for none
+    int32_t signals, wait_signals;
+    osEvent result;               // Filled in by whoever ends the wait
+};
+
+static struct os_thread_cb threads[SIM_THREADS];
+static int thread_top;            // Slots ever used, the rest are not scanned
+static struct os_thread_cb *current;
+static struct os_timer_cb *timers;
+static struct os_thread_cb *timer_thread;
+static uint64_t ready_seq, now_ms, slice_start_ms, start_ns;
+static uint64_t wake_due;         // No wait times out before this
+static int running, virtual_time;
+static uint64_t switches;
+static struct { os_pthread func; osPriority prio; } sim_threads[4];
+static int sim_thread_count;
+
+volatile uint32_t os_idle_cycles; // As counted by os_idle_demon in RTX_Conf_CM.c
+
+static void reschedule(void);
+
+uint64_t os_sim_now_ms(void) {
+    return now_ms;
+}
+
+uint64_t os_sim_switches(void) {
+    return switches;
+}
+
+void os_sim_virtual_time(void) {
+    virtual_time = 1;
+    hal_host.virtual_time = 1;
+}
+
+void os_sim_thread(os_pthread func, osPriority prio) {
+    sim_threads[sim_thread_count].func = func;
+    sim_threads[sim_thread_count++].prio = prio;
+}
+
+static void make_ready(struct os_thread_cb *t, osStatus status) {
+    t->state = T_READY;
+    t->ready_seq = ++ready_seq;
+    t->object = NULL;
+    t->result.status = status;
+}
+
+// A thread runs at the higher of its own priority and that of the threads
+// waiting for a mutex it holds. Recomputed whenever either changes, and
+// passed on to the holder of the mutex the thread is itself waiting for.
+static void inherit(struct os_thread_cb *t) {
+    while (t != NULL) {
+        int prio = t->base_prio;
+        for (int i = 0; i < thread_top; i++) {
+            struct os_thread_cb *w = &threads[i];
+            if (w->state == T_WAIT && w->wait == W_MUTEX && ((struct os_mutex_cb *)w->object)->owner == t &&
+                w->prio > prio)
+                prio = w->prio;
+        }
+        if (prio == t->prio) return;
+        t->prio = prio;
+        t = t->state == T_WAIT && t->wait == W_MUTEX ? ((struct os_mutex_cb *)t->object)->owner : NULL;
+    }
+}
+
+// Catches the kernel clock up and ends the waits that timed out
+static void advance_clock(void) {
+    uint64_t ms = (hal_host_ns() - start_ns) / 1000000;
+
+    if (ms > now_ms) now_ms = ms;
+    if (now_ms < wake_due) return;
+    wake_due = FOREVER;
+    for (int i = 0; i < thread_top; i++) {
+        struct os_thread_cb *t = &threads[i];
+        if (t->state != T_WAIT) continue;
+        if (t->wake_ms > now_ms) {
+            if (t->wake_ms < wake_due) wake_due = t->wake_ms;
+            continue;
+        }
+        if (t->wait == W_MUTEX) {
+            struct os_mutex_cb *mutex = t->object;
+            make_ready(t, osErrorTimeoutResource);
+            inherit(mutex->owner); // The holder no longer runs for this thread
+        } else {
+            make_ready(t, osEventTimeout);
+        }
+        t->result.value.v = 0;
+    }
+}
+
+static struct os_thread_cb *pick(void) {
+    struct os_thread_cb *best = NULL;
+    for (int i = 0; i < thread_top; i++) {
+        struct os_thread_cb *t = &threads[i];
+        if (t->state == T_READY &&
+            (best == NULL || t->prio > best->prio || (t->prio == best->prio && t->ready_seq < best->ready_seq)))
+            best = t;
+    }
+    return best;
+}
+
+static uint64_t next_wake(void) {
+    uint64_t wake = FOREVER;
+    for (int i = 0; i < thread_top; i++) {
+        if (threads[i].state == T_WAIT && threads[i].wake_ms < wake) wake = threads[i].wake_ms;
+    }
+    return wake;
+}
+
+// Nothing is ready: wait for the next timeout. Only timeouts can make a
+// thread ready here, the simulated peripherals are all polled.
+static void idle(void) {
+    uint64_t wake = next_wake();
+    uint64_t ns = wake == FOREVER ? hal_host_ns() + 10000000 : start_ns + wake * 1000000;
+    uint64_t before = hal_host_ns();
+
+    if (virtual_time) {
+        if (wake == FOREVER) {
+            fprintf(stderr, "os_sim: every thread waits forever\n");
+            exit(1);
+        }
+        hal_host.virtual_ns = ns;
+    } else {
+        struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0);
+    }
+    os_idle_cycles += (hal_host_ns() - before) / (1000000000 / osKernelSysTickFrequency);
+}
+
+// Gives the CPU to the thread that should run now, which may be the caller.
+// The caller returns from here once it is picked again.
+static void reschedule(void) {
+    struct os_thread_cb *self = current, *next;
+
+    if (!running) return;
+    advance_clock();
+    if (self->state == T_READY && now_ms - slice_start_ms >= ROBIN_MS) {
+        self->ready_seq = ++ready_seq; // Slice used up, behind its equals
+        slice_start_ms = now_ms;
+    }
+    while ((next = pick()) == NULL) {
+        idle();
+        advance_clock();
+    }
+    if (next == self) return;
+    current = next;
+    slice_start_ms = now_ms;
+    switches++;
+    if (self->state != T_DONE && _setjmp(self->jump) != 0) return; // Picked again; a done stack is not reused
+    if (next->started) _longjmp(next->jump, 1);
+    next->started = 1;
+    setcontext(&next->context);
+}
+
+// Blocks the running thread and returns the result of the wait
+static osEvent block(int wait, void *object, uint32_t millisec) {
+    struct os_thread_cb *self = current;
+
+    advance_clock();
+    self->state = T_WAIT;
+    self->wait = wait;
+    self->object = object;
+    self->wake_ms = millisec == osWaitForever ? FOREVER : now_ms + millisec;
+    if (self->wake_ms < wake_due) wake_due = self->wake_ms;
+    if (wait == W_MUTEX) inherit(((struct os_mutex_cb *)object)->owner); // Priority inheritance
+    reschedule();
+    return self->result;
+}
+
+// The highest priority, longest waiting thread blocked on object
+static struct os_thread_cb *waiter(int wait, void *object) {
+    struct os_thread_cb *best = NULL;
+    for (int i = 0; i < thread_top; i++) {
+        struct os_thread_cb *t = &threads[i];
+        if (t->state == T_WAIT && t->wait == wait && t->object == object &&
+            (best == NULL || t->prio > best->prio || (t->prio == best->prio && t->ready_seq < best->ready_seq)))
+            best = t;
+    }
+    return best;
+}
+
+static void trampoline(void) {
+    current->func(current->argument);
+    osThreadTerminate(current); // Returning ends the thread, as in RTX
+}
+
+// func NULL for the thread already running, main()
+static struct os_thread_cb *new_thread(os_pthread func, void *argument, osPriority prio) {
+    for (int i = 0; i < SIM_THREADS; i++) {
+        struct os_thread_cb *t = &threads[i];
+        if (t->state != T_FREE) continue;
+        if (i >= thread_top) thread_top = i + 1;
+        memset(t, 0, sizeof(*t));
+        t->func = func;
+        t->argument = argument;
+        t->prio = t->base_prio = prio;
+        if (func != NULL) {
+            getcontext(&t->context);
+            t->context.uc_stack.ss_sp = malloc(SIM_STACK);
+            t->context.uc_stack.ss_size = SIM_STACK;
+            t->context.uc_link = NULL;
+            makecontext(&t->context, trampoline, 0);
+        }
+        t->started = func == NULL;
+        make_ready(t, osOK);
+        return t;
+    }
+    return NULL;
+}
+
+// osTimerThread. Runs every due callback in turn, then sleeps until the
+// earliest running timer is due.
+static void timer_loop(const void *arg) {
+    while (1) {
+        struct os_timer_cb *tm;
+        uint64_t due = FOREVER;
+
+        advance_clock();
+        for (tm = timers; tm != NULL; tm = tm->next) {
+            if (tm->running && tm->due_ms <= now_ms) break;
+        }
+        if (tm != NULL) {
+            if (tm->type == osTimerPeriodic) tm->due_ms += tm->period_ms; else tm->running = 0;
+            tm->ptimer(tm->argument);
+            continue; // The callback may have started or stopped timers
+        }
+        for (tm = timers; tm != NULL; tm = tm->next) {
+            if (tm->running && tm->due_ms < due) due = tm->due_ms;
+        }
+        block(W_TIMER, NULL, due == FOREVER ? osWaitForever : (uint32_t)(due - now_ms));
+    }
+}
+
+osStatus osKernelInitialize(void) {
+    start_ns = hal_host_ns();
+    current = new_thread(NULL, NULL, osPriorityNormal);
+    timer_thread = new_thread(timer_loop, NULL, osPriorityHigh);
+    for (int i = 0; i < sim_thread_count; i++) new_thread(sim_threads[i].func, NULL, sim_threads[i].prio);
+    return osOK;
+}
+
+osStatus osKernelStart(void) {
+    running = 1;
+    slice_start_ms = now_ms;
+    reschedule();
+    return osOK;
+}
+
+int32_t osKernelRunning(void) {
+    return running;
+}
+
+uint32_t osKernelSysTick(void) {
+    return (uint32_t)((hal_host_ns() - start_ns) / (1000000000 / osKernelSysTickFrequency));
+}
+
+osThreadId osThreadCreate(const osThreadDef_t *thread_def, void *argument) {
+    struct os_thread_cb *t = new_thread(thread_def->pthread, argument, thread_def->tpriority);
+
+    if (t == NULL) return NULL;
+    reschedule();
+    return t;
+}
+
+osThreadId osThreadGetId(void) {
+    return current;
+}
+
+osStatus osThreadTerminate(osThreadId thread_id) {
+    if (thread_id == NULL || thread_id->state == T_FREE || thread_id->state == T_DONE) return osErrorParameter;
+    thread_id->state = T_DONE;
+    if (thread_id == current) reschedule(); // Does not return
+    return osOK;
+}
+
+osStatus osThreadYield(void) {
+    current->ready_seq = ++ready_seq;
+    reschedule();
+    return osOK;
+}
+
+osStatus osThreadSetPriority(osThreadId thread_id, osPriority priority) {
+    if (thread_id == NULL) return osErrorParameter;
+    thread_id->base_prio = priority;
+    inherit(thread_id);
+    reschedule();
+    return osOK;
+}
+
+osPriority osThreadGetPriority(osThreadId thread_id) {
+    return thread_id != NULL ? (osPriority)thread_id->base_prio : osPriorityError;
+}
+
+osStatus osDelay(uint32_t millisec) {
+    return block(W_DELAY, NULL, millisec).status;
+}
+
+osTimerId osTimerCreate(const osTimerDef_t *timer_def, os_timer_type type, void *argument) {
+    struct os_timer_cb *tm = timer_def->timer;
+
+    memset(tm, 0, sizeof(*tm));
+    tm->ptimer = timer_def->ptimer;
+    tm->argument = argument;
+    tm->type = type;
+    tm->next = timers;
+    timers = tm;
+    return tm;
+}
+
+static void wake_timer_thread(void) {
+    if (timer_thread->state == T_WAIT) make_ready(timer_thread, osOK);
+}
+
+osStatus osTimerStart(osTimerId timer_id, uint32_t millisec) {
+    advance_clock();
+    timer_id->period_ms = millisec;
+    timer_id->due_ms = now_ms + millisec;
+    timer_id->running = 1;
+    wake_timer_thread();
+    reschedule();
+    return osOK;
+}
+
+osStatus osTimerStop(osTimerId timer_id) {
+    if (!timer_id->running) return osErrorResource;
+    timer_id->running = 0;
+    return osOK;
+}
+
+static int signals_met(struct os_thread_cb *t) {
+    return t->wait_signals == 0 ? t->signals != 0 : (t->signals & t->wait_signals) == t->wait_signals;
+}
+
+// Ends a signal wait that is met, clearing the flags it consumed
+static osEvent take_signals(struct os_thread_cb *t) {
+    osEvent ev;
+    ev.status = osEventSignal;
+    ev.value.signals = t->wait_signals == 0 ? t->signals : t->wait_signals;
+    t->signals &= ~ev.value.signals;
+    return ev;
+}
+
+int32_t osSignalSet(osThreadId thread_id, int32_t signals) {
+    int32_t old;
+
+    if (thread_id == NULL || thread_id->state == T_FREE) return (int32_t)0x80000000;
+    old = thread_id->signals;
+    thread_id->signals |= signals;
+    if (thread_id->state == T_WAIT && thread_id->wait == W_SIGNAL && signals_met(thread_id)) {
+        osEvent ev = take_signals(thread_id);
+        make_ready(thread_id, osEventSignal);
+        thread_id->result = ev;
+        reschedule();
+    }
+    return old;
+}
+
+int32_t osSignalClear(osThreadId thread_id, int32_t signals) {
+    int32_t old = thread_id->signals;
+    thread_id->signals &= ~signals;
+    return old;
+}
+
+osEvent osSignalWait(int32_t signals, uint32_t millisec) {
+    osEvent ev;
+
+    current->wait_signals = signals;
+    if (signals_met(current)) return take_signals(current);
+    if (millisec == 0) {
+        ev.status = osOK;
+        return ev;
+    }
+    return block(W_SIGNAL, NULL, millisec);
+}
+
+osMutexId osMutexCreate(const osMutexDef_t *mutex_def) {
+    memset(mutex_def->mutex, 0, sizeof(*mutex_def->mutex));
+    return mutex_def->mutex;
+}
+
+osStatus osMutexWait(osMutexId mutex_id, uint32_t millisec) {
+    struct os_thread_cb *self = current;
+
+    if (mutex_id->owner == NULL || mutex_id->owner == self) {
+        mutex_id->owner = self;
+        mutex_id->count++;
+        reschedule(); // A scheduling point like any other call
+        return osOK;
+    }
+    if (millisec == 0) return osErrorResource;
+    return block(W_MUTEX, mutex_id, millisec).status;
+}
+
+osStatus osMutexRelease(osMutexId mutex_id) {
+    struct os_thread_cb *self = current, *next;
+
+    if (mutex_id->owner != self) return osErrorResource;
+    if (--mutex_id->count > 0) return osOK;
+    next = waiter(W_MUTEX, mutex_id);
+    mutex_id->owner = next;
+    if (next != NULL) {
+        mutex_id->count = 1;
+        make_ready(next, osOK);
+        inherit(next); // Now holds it for the threads still waiting
+    }
+    inherit(self); // Keeps what the mutexes it still holds give it
+    reschedule();
+    return osOK;
+}
+
+osSemaphoreId osSemaphoreCreate(const osSemaphoreDef_t *semaphore_def, int32_t count) {
+    semaphore_def->semaphore->tokens = count;
+    return semaphore_def->semaphore;
+}
+
+// Returns the tokens available before the wait, as RTX does, 0 on timeout
+int32_t osSemaphoreWait(osSemaphoreId semaphore_id, uint32_t millisec) {
+    if (semaphore_id->tokens > 0) {
+        reschedule();
+        return semaphore_id->tokens--;
+    }
+    if (millisec == 0) return 0;
+    return block(W_SEMAPHORE, semaphore_id, millisec).status == osOK ? 1 : 0;
+}
+
+osStatus osSemaphoreRelease(osSemaphoreId semaphore_id) {
+    struct os_thread_cb *next = waiter(W_SEMAPHORE, semaphore_id);
+
+    if (next != NULL) make_ready(next, osOK); // The token goes straight to it
+    else semaphore_id->tokens++;
+    reschedule();
+    return osOK;
+}
+
+osMailQId osMailCreate(const osMailQDef_t *queue_def, osThreadId thread_id) {
+    struct os_mailQ_cb *q = queue_def->pool;
+
+    q->queue_sz = queue_def->queue_sz;
+    q->item_sz = queue_def->item_sz;
+    q->blocks = malloc(q->queue_sz * q->item_sz);
+    q->in_use = calloc(q->queue_sz, 1);
+    q->fifo = calloc(q->queue_sz, sizeof(void *));
+    q->head = q->count = 0;
+    return q;
+}
+
+void *osMailAlloc(osMailQId queue_id, uint32_t millisec) {
+    for (uint32_t i = 0; i < queue_id->queue_sz; i++) {
+        if (queue_id->in_use[i]) continue;
+        queue_id->in_use[i] = 1;
+        return queue_id->blocks + i * queue_id->item_sz;
+    }
+    return NULL;
+}
+
+void *osMailCAlloc(osMailQId queue_id, uint32_t millisec) {
+    void *mail = osMailAlloc(queue_id, millisec);
+    if (mail != NULL) memset(mail, 0, queue_id->item_sz);
+    return mail;
+}
+
+osStatus osMailPut(osMailQId queue_id, void *mail) {
+    struct os_thread_cb *next = waiter(W_MAIL, queue_id);
+
+    if (next != NULL) {
+        make_ready(next, osEventMail);
+        next->result.value.p = mail;
+        next->result.def.mail_id = queue_id;
+        reschedule();
+        return osOK;
+    }
+    if (queue_id->count == queue_id->queue_sz) return osErrorResource;
+    queue_id->fifo[(queue_id->head + queue_id->count++) % queue_id->queue_sz] = mail;
+    return osOK;
+}
+
+osEvent osMailGet(osMailQId queue_id, uint32_t millisec) {
+    osEvent ev;
+
+    ev.def.mail_id = queue_id;
+    if (queue_id->count > 0) {
+        ev.status = osEventMail;
+        ev.value.p = queue_id->fifo[queue_id->head];
+        queue_id->head = (queue_id->head + 1) % queue_id->queue_sz;
+        queue_id->count--;
+        return ev;
+    }
+    if (millisec == 0) {
+        ev.status = osOK;
+        return ev;
+    }
+    return block(W_MAIL, queue_id, millisec);
+}
+
+osStatus osMailFree(osMailQId queue_id, void *mail) {
+    uint32_t i = ((uint8_t *)mail - queue_id->blocks) / queue_id->item_sz;
+
+    if (i >= queue_id->queue_sz || !queue_id->in_use[i]) return osErrorValue;
+    queue_id->in_use[i] = 0;
+    return osOK;
+}
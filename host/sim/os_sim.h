@@ -0,0 +1,20 @@
+#ifndef OS_SIM_H
+#define OS_SIM_H
+
+#include <stdint.h>
+#include "cmsis_os.h"
+
+// Simulation side of the cmsis_os.h shim in os_sim.c
+
+uint64_t os_sim_now_ms(void);   // Kernel tick count
+uint64_t os_sim_switches(void); // Context switches since osKernelStart()
+
+// Before osKernelInitialize(). The kernel clock, and with it hal_host_ns(),
+// then only moves when every thread waits, straight to the next timeout.
+void os_sim_virtual_time(void);
+
+// Before osKernelInitialize(): a thread of the simulation itself, created
+// with the kernel's timer thread. Up to four.
+void os_sim_thread(os_pthread func, osPriority prio);
+
+#endif
@@ -0,0 +1,129 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "plant.h"
+
+#define DAY_S 86400.0
+#define YEAR_DAYS 365.0
+#define SOLSTICE_DAY 171.0          // 21 June, longest day
+#define WARMEST_DAY 195.0           // Mid July, outdoor temperatures lag the sun
+
+static const struct {
+    const char *name;
+    size_t offset;
+} params[] = {
+#define PARAM(name) { #name, offsetof(PlantConfig, name) }
+    PARAM(start_day), PARAM(start_hour), PARAM(outside_c), PARAM(outside_day_c), PARAM(outside_year_c),
+    PARAM(heat_capacity), PARAM(heat_loss), PARAM(heater_w), PARAM(solar_w),
+    PARAM(evaporation), PARAM(evaporation_sun), PARAM(evaporation_temp), PARAM(irrigation),
+    PARAM(day_hours), PARAM(day_year_hours), PARAM(temp_adc_0c), PARAM(temp_adc_per_c),
+    PARAM(moist_adc_dry), PARAM(moist_adc_wet), PARAM(sun_adc), PARAM(lamp_adc),
+#undef PARAM
+};
+
+void plant_default_config(PlantConfig *cfg) {
+    cfg->start_day = 79;            // 21 March
+    cfg->start_hour = 0;
+    cfg->outside_c = 10;
+    cfg->outside_day_c = 5;
+    cfg->outside_year_c = 8;
+    cfg->heat_capacity = 1.5e6;     // About 3 hours to settle
+    cfg->heat_loss = 150;
+    cfg->heater_w = 6000;
+    cfg->solar_w = 4000;
+    cfg->evaporation = 0.02;
+    cfg->evaporation_sun = 0.06;
+    cfg->evaporation_temp = 0.05;
+    cfg->irrigation = 2;
+    cfg->day_hours = 12;
+    cfg->day_year_hours = 4;
+    cfg->temp_adc_0c = 2680;        // The default HEATER_TH of 1600 is then 18 C
+    cfg->temp_adc_per_c = 60;
+    cfg->moist_adc_dry = 500;
+    cfg->moist_adc_wet = 3500;
+    cfg->sun_adc = 3500;
+    cfg->lamp_adc = 500;
+}
+
+int plant_set(PlantConfig *cfg, const char *assignments) {
+    const char *p = assignments;
+
+    while (*p != '\0') {
+        char name[32];
+        double value;
+        int len = 0;
+        size_t i;
+
+        if (sscanf(p, "%31[^=,]=%lf%n", name, &value, &len) != 2 || (p[len] != ',' && p[len] != '\0')) {
+            fprintf(stderr, "plant: bad setting at \"%s\"\n", p);
+            return -1;
+        }
+        for (i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+            if (strcmp(params[i].name, name) == 0) break;
+        }
+        if (i == sizeof(params) / sizeof(params[0])) {
+            fprintf(stderr, "plant: no setting \"%s\"\n", name);
+            return -1;
+        }
+        *(double *)((char *)cfg + params[i].offset) = value;
+        p += len + (p[len] == ',');
+    }
+    return 0;
+}
+
+// Daylight at time t, 0 at night to 1 at noon on the longest day
+static double sun_at(const PlantConfig *cfg, double t) {
+    double day = cfg->start_day + cfg->start_hour / 24 + t / DAY_S;
+    double hour = (day - floor(day)) * 24;
+    double length = cfg->day_hours + cfg->day_year_hours * cos(2 * M_PI * (day - SOLSTICE_DAY) / YEAR_DAYS);
+    double since_rise = hour - (12 - length / 2);
+
+    if (since_rise <= 0 || since_rise >= length) return 0;
+    return sin(M_PI * since_rise / length) * length / (cfg->day_hours + cfg->day_year_hours);
+}
+
+static double outside_at(const PlantConfig *cfg, double t) {
+    double day = cfg->start_day + cfg->start_hour / 24 + t / DAY_S;
+    double hour = (day - floor(day)) * 24;
+
+    return cfg->outside_c + cfg->outside_year_c * cos(2 * M_PI * (day - WARMEST_DAY) / YEAR_DAYS) +
+           cfg->outside_day_c * cos(2 * M_PI * (hour - 15) / 24);
+}
+
+void plant_init(PlantState *s, const PlantConfig *cfg) {
+    s->time_s = 0;
+    s->temp_c = outside_at(cfg, 0);
+    s->moisture = 0.5;
+    s->sun = sun_at(cfg, 0);
+}
+
+// Both parts of the model are x' = (x_eq - x) * k with the inputs held over
+// the step, which has the exact solution used here
+void plant_step(PlantState *s, const PlantConfig *cfg, const double on[3], double dt) {
+    double mid = s->time_s + dt / 2;
+    double sun = sun_at(cfg, mid);
+    double temp_eq = outside_at(cfg, mid) + (cfg->heater_w * on[PLANT_HEATER] + cfg->solar_w * sun) / cfg->heat_loss;
+    double warm = 1 + cfg->evaporation_temp * (s->temp_c - 20);
+    double dry = (cfg->evaporation + cfg->evaporation_sun * sun) * (warm > 0 ? warm : 0);
+    double wet = cfg->irrigation * on[PLANT_SPRINKLER];
+
+    s->temp_c = temp_eq + (s->temp_c - temp_eq) * exp(-dt * cfg->heat_loss / cfg->heat_capacity);
+    if (dry + wet > 0) {
+        double moist_eq = wet / (dry + wet);
+        s->moisture = moist_eq + (s->moisture - moist_eq) * exp(-dt * (dry + wet) / 3600);
+    }
+    s->time_s += dt;
+    s->sun = sun_at(cfg, s->time_s);
+}
+
+// Kept off 0 and 0xFFF, which the firmware takes for a failed sensor
+static int adc_clamp(double v) {
+    return v < 1 ? 1 : v > 0xFFE ? 0xFFE : (int)(v + 0.5);
+}
+
+void plant_adc(const PlantState *s, const PlantConfig *cfg, int lamp_on, int adc[3]) {
+    adc[0] = adc_clamp(cfg->temp_adc_0c - cfg->temp_adc_per_c * s->temp_c);
+    adc[1] = adc_clamp(cfg->moist_adc_dry + (cfg->moist_adc_wet - cfg->moist_adc_dry) * s->moisture);
+    adc[2] = adc_clamp(cfg->sun_adc * s->sun + (lamp_on ? cfg->lamp_adc : 0));
+}
@@ -0,0 +1,66 @@
+#ifndef PLANT_H
+#define PLANT_H
+
+// Physical model of the greenhouse for closed-loop simulation, in plant.c.
+// It takes the actuator states and gives the three sensor readings, so the
+// unchanged control code can be run against it:
+//
+//  - the air has a thermal mass, loses heat through the cover towards an
+//    outdoor temperature that follows the day and the season, and gains it
+//    from the heater and the sun;
+//  - the soil dries by evaporation, faster when warm and sunny, and the
+//    sprinkler brings it towards saturation;
+//  - daylight follows the sun, with day length changing over the year, and
+//    the grow light adds to what the light sensor sees.
+//
+// Each step is solved exactly for constant inputs over the step, so any step
+// length is stable and a step costs a few exp() and sin() calls.
+
+enum { PLANT_HEATER, PLANT_SPRINKLER, PLANT_LIGHT };
+
+typedef struct {
+    double start_day;           // Day of the year at time 0, 0 for 1 January
+    double start_hour;
+    double outside_c;           // Mean outdoor temperature
+    double outside_day_c;       // Half the day-night swing, warmest at 15:00
+    double outside_year_c;      // Half the summer-winter swing, warmest mid July
+    double heat_capacity;       // J/K of air, soil and benches
+    double heat_loss;           // W/K through the cover
+    double heater_w;
+    double solar_w;             // Heat gained in full sun
+    double evaporation;         // Fraction of the soil water lost per hour at 20 C in the dark
+    double evaporation_sun;     // Added in full sun
+    double evaporation_temp;    // Relative change per degree from 20 C
+    double irrigation;          // Fraction of the gap to saturation filled per hour of sprinkling
+    double day_hours;           // Mean day length
+    double day_year_hours;      // Half its summer-winter swing
+    double temp_adc_0c;         // Temperature sensor reading at 0 C
+    double temp_adc_per_c;      // Counts it falls per degree (NTC divider)
+    double moist_adc_dry;       // Moisture sensor in dry and saturated soil
+    double moist_adc_wet;
+    double sun_adc;             // Light sensor in full sun
+    double lamp_adc;            // Added by the grow light
+} PlantConfig;
+
+typedef struct {
+    double time_s;              // Since the start
+    double temp_c;              // Inside air
+    double moisture;            // Soil water, 0 dry to 1 saturated
+    double sun;                 // Daylight, 0 to 1
+} PlantState;
+
+void plant_default_config(PlantConfig *cfg);
+
+// Applies "name=value,name=value" to cfg. Returns 0, or -1 naming the first
+// unknown or malformed entry on stderr.
+int plant_set(PlantConfig *cfg, const char *assignments);
+
+void plant_init(PlantState *s, const PlantConfig *cfg); // At the outdoor temperature, soil half wet
+
+// Advances dt seconds, with each actuator on for the fraction on[PLANT_] of it
+void plant_step(PlantState *s, const PlantConfig *cfg, const double on[3], double dt);
+
+// ADC channels 0-2 as the sensors read them now, lamp_on for the grow light
+void plant_adc(const PlantState *s, const PlantConfig *cfg, int lamp_on, int adc[3]);
+
+#endif
@@ -0,0 +1,66 @@
+// Host benchmark of the plant model in plant.c: a year at 1 Hz, closed
+// loop with the firmware's decision rule (each second an actuator whose
+// reading is past its threshold runs for its ON duration), without the
+// firmware itself. Prints the cost of a step and a month by month summary
+// of how well the greenhouse is held.
+//
+//   gcc -O2 plant_bench.c plant.c -lm -o plant_bench && ./plant_bench [name=value,...] [heater_th,sprinkler_th,light_th]
+
+#include <stdio.h>
+#include <time.h>
+#include "plant.h"
+
+#define YEAR_S (365 * 86400)
+#define MONTH_S (YEAR_S / 12)
+
+// Firmware defaults for the ON durations, as fractions of the 1 s check
+static const double on_fraction[3] = { 0.5, 0.6, 0.7 };
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    PlantConfig cfg;
+    PlantState s;
+    int th[3] = { 1600, 2000, 1000 }; // HEATER_TH, and a SPRINKLER_TH and LIGHT_TH that do not always trigger
+    double on[3] = { 0, 0, 0 };
+    double t0, wall;
+    double tmin = 1e9, tmax = -1e9, tsum = 0, msum = 0, heat_j = 0, sprinkle_s = 0, lamp_s = 0;
+
+    plant_default_config(&cfg);
+    if (argc > 1 && plant_set(&cfg, argv[1]) != 0) return 2;
+    if (argc > 2) sscanf(argv[2], "%d,%d,%d", &th[0], &th[1], &th[2]);
+    plant_init(&s, &cfg);
+
+    printf("month  inside C min/mean/max   moisture  heater kWh  sprinkler h  lamp h\n");
+    t0 = now_s();
+    for (int i = 1; i <= YEAR_S; i++) {
+        int adc[3];
+
+        plant_adc(&s, &cfg, on[PLANT_LIGHT] > 0, adc);
+        on[PLANT_HEATER] = adc[0] >= th[0] ? on_fraction[0] : 0;
+        on[PLANT_SPRINKLER] = adc[1] <= th[1] ? on_fraction[1] : 0;
+        on[PLANT_LIGHT] = adc[2] <= th[2] ? on_fraction[2] : 0;
+        plant_step(&s, &cfg, on, 1);
+
+        if (s.temp_c < tmin) tmin = s.temp_c;
+        if (s.temp_c > tmax) tmax = s.temp_c;
+        tsum += s.temp_c;
+        msum += s.moisture;
+        heat_j += on[PLANT_HEATER] * cfg.heater_w;
+        sprinkle_s += on[PLANT_SPRINKLER];
+        lamp_s += on[PLANT_LIGHT];
+        if (i % MONTH_S == 0) {
+            printf("%5d  %6.1f %6.1f %6.1f   %8.2f  %10.1f  %11.1f  %6.1f\n", i / MONTH_S, tmin, tsum / MONTH_S, tmax,
+                   msum / MONTH_S, heat_j / 3.6e6, sprinkle_s / 3600, lamp_s / 3600);
+            tmin = 1e9, tmax = -1e9, tsum = msum = heat_j = sprinkle_s = lamp_s = 0;
+        }
+    }
+    wall = now_s() - t0;
+    printf("%d steps in %.2f s, %.1f ns per step with the decision, %.0f sim-s/wall-s\n",
+           YEAR_S, wall, wall * 1e9 / YEAR_S, YEAR_S / wall);
+    return 0;
+}
@@ -0,0 +1,345 @@
+// Runs the whole firmware as a Linux process: main.c and its threads on the
+// cmsis_os.h shim, the HAL on simulated hardware, the flash sectors in a
+// file, and UART0 and the RS-485 UART on pseudo-terminals, which the host
+// tools and scripts open like the board's serial ports.
+//
+// With -t the firmware instead runs in virtual time for that many simulated
+// seconds, as fast as it can: the clock jumps to the next osDelay, timeout or
+// timer whenever every thread waits. Console input comes from the -s script,
+// the output of both UARTs goes to the -o file, and a run ends with a report
+// of the speedup, the actuator on times and a digest of everything sent.
+// The same options give the same run, byte for byte.
+//
+// In either mode the sensors can instead read the plant model of plant.h,
+// which the actuators act on, to run the control loop closed.
+//
+// -r replays a trace recorded from a board (host/trace/trace.h) in virtual
+// time: its scans go through Sensor_Thread in replay mode, its commands
+// through the console, and the report ends with where the actuator states
+// differ from the recording.
+//
+//   cmake -S . -B build && cmake --build build
+//   build/greenhouse_sim [-f flash.bin] [-a temp,moist,light | -m] [-l link]
+//   build/greenhouse_sim -t 604800 [-s script] [-o out.txt] [-f flash.bin] [-a ... | -m]
+//   build/greenhouse_sim -r site.trace [-o out.txt] [-f flash.bin]
+//
+//   -f  flash image, created blank if missing (greenhouse_flash.bin; in
+//       virtual time blank sectors in memory unless given)
+//   -a  fixed ADC readings for channels 0-2 (2000,2500,3000)
+//   -m  plant model instead, name=value,... to change its PlantConfig
+//       (-m "" for the defaults); with -o it logs its state every minute
+//   -l  also make <link>.uart0 and <link>.rs485 symlinks to the terminals
+//   -t  simulated seconds to run in virtual time
+//   -s  console input, "<seconds> <command>" per line, in time order
+//   -o  file for what the UARTs send, each line prefixed with its port
+//   -r  trace to replay, runs until it is done
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "hal.h"
+#include "cmsis_os.h"
+#include "os_sim.h"
+#include "flash_sim.h"
+#include "plant.h"
+#include "trace.h"
+
+#define SIM_STEP_MS 100         // Script, output and plant model resolution
+#define PLANT_LOG_S 60
+#define REPLAY_START_MS 1000    // Once the firmware is up
+#define REPLAY_DRAIN_MS 500     // For the last replies
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+int firmware_main(void);        // main() of main.c, renamed by the build
+
+static int pty[2];              // Master sides, by HAL_UART_ port
+
+static uint64_t run_ms;         // Virtual time run length, 0 for real time
+static FILE *script, *out;
+static uint64_t digest = FNV_OFFSET;
+static double wall_start;
+
+static int plant_on;
+static PlantConfig plant_cfg;
+static PlantState plant;
+static double plant_min = 1e9, plant_max = -1e9, plant_sum, moist_sum;
+static uint64_t plant_steps;
+
+static int replaying;
+static TraceReader replay_trace;
+static TraceReplay replay;
+
+// Opens a raw pseudo-terminal and keeps its slave side open, so the master
+// never sees a hangup when a tool closes the port
+static int open_pty(const char *link, const char *suffix, char *name, int size) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    struct termios tio;
+    int slave;
+
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 || ptsname_r(master, name, size) != 0) return -1;
+    slave = open(name, O_RDWR | O_NOCTTY);
+    if (slave < 0) return -1;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    if (link != NULL) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s.%s", link, suffix);
+        unlink(path);
+        if (symlink(name, path) != 0) perror(path);
+    }
+    return master;
+}
+
+// Moves bytes between the terminals and the HAL FIFOs. What a terminal does
+// not take is dropped, as a disconnected serial line would.
+static void *uart_pump(void *arg) {
+    struct pollfd fds[2] = { { pty[0], POLLIN, 0 }, { pty[1], POLLIN, 0 } };
+    char buf[256];
+    int n;
+
+    while (1) {
+        poll(fds, 2, 1);
+        for (int port = 0; port < 2; port++) {
+            if ((fds[port].revents & POLLIN) && (n = read(pty[port], buf, sizeof(buf))) > 0)
+                hal_host_uart_feed(port, buf, n);
+            while ((n = hal_host_uart_take(port, buf, sizeof(buf))) > 0) {
+                if (write(pty[port], buf, n) < 0) break;
+            }
+        }
+    }
+    return NULL;
+}
+
+static double wall_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void hash(const void *data, int len) {
+    const uint8_t *p = data;
+    for (int i = 0; i < len; i++) digest = (digest ^ p[i]) * FNV_PRIME;
+}
+
+// Hashes and writes what a port sent, line by line with its port in front,
+// and passes console lines on to the replay
+static void drain(int port) {
+    static const char *const name[2] = { "uart0", "rs485" };
+    static int line_start[2] = { 1, 1 };
+    static char line[256];
+    static int line_len;
+    char buf[256];
+    int n;
+
+    while ((n = hal_host_uart_take(port, buf, sizeof(buf))) > 0) {
+        hash(&port, 1);
+        hash(buf, n);
+        for (int i = 0; i < n; i++) {
+            if (out != NULL) {
+                if (line_start[port]) fprintf(out, "%s ", name[port]);
+                fputc(buf[i], out);
+            }
+            line_start[port] = buf[i] == '\n';
+            if (!replaying || port != HAL_UART_CONSOLE) continue;
+            if (buf[i] == '\n') {
+                line[line_len] = '\0';
+                trace_replay_output(&replay, line);
+                line_len = 0;
+            } else if (line_len < (int)sizeof(line) - 1) {
+                line[line_len++] = buf[i];
+            }
+        }
+    }
+}
+
+// Sends the trace lines that are due, returns ms until the next one
+static uint64_t replay_step(uint64_t now) {
+    char line[TRACE_LINE + 1];
+    uint32_t elapsed = now - REPLAY_START_MS, due;
+    int state;
+
+    if (now < REPLAY_START_MS) return REPLAY_START_MS - now;
+    while ((state = trace_replay_line(&replay, elapsed, line, TRACE_LINE, &due)) == 1) {
+        strcat(line, "\n");
+        hal_host_uart_feed(HAL_UART_CONSOLE, line, strlen(line));
+    }
+    if (state < 0) {
+        if (run_ms == UINT64_MAX) run_ms = now + REPLAY_DRAIN_MS;
+        return SIM_STEP_MS;
+    }
+    return due - elapsed;
+}
+
+static void report(void) {
+    static const char *const name[3] = { "heater", "sprinkler", "light" };
+    double wall = wall_s() - wall_start, sim = run_ms / 1000.0;
+
+    for (int i = 0; i < 3; i++) {
+        uint64_t on = hal_host_on_ns(i);
+        hash(&on, sizeof(on));
+        hash(&hal_host.switches[i], sizeof(hal_host.switches[i]));
+    }
+    printf("simulated %.0f s in %.2f s wall, %.0f sim-s/wall-s, %llu context switches\n",
+           sim, wall, sim / wall, (unsigned long long)os_sim_switches());
+    for (int i = 0; i < 3; i++) {
+        printf("%-9s on %9.1f s (%5.2f%%), %u switches\n", name[i], hal_host_on_ns(i) / 1e9,
+               hal_host_on_ns(i) / 1e7 / sim, hal_host.switches[i]);
+    }
+    if (plant_on) {
+        hash(&plant, sizeof(plant));
+        printf("inside %.1f / %.1f / %.1f C min / mean / max, moisture mean %.2f, now %.2f\n",
+               plant_min, plant_sum / plant_steps, plant_max, moist_sum / plant_steps, plant.moisture);
+    }
+    printf("digest %016llx\n", (unsigned long long)digest);
+    if (replaying) trace_replay_report(&replay, stdout);
+}
+
+// Moves the plant model on to now with the actuators as they were since the
+// last step, counting the exact time each was on, and sets the sensor inputs
+static void plant_update(void) {
+    static uint64_t last_ns, last_on[3];
+    uint64_t now = hal_host_ns();
+    double on[3];
+
+    if (last_ns != 0 && now > last_ns) {
+        for (int i = 0; i < 3; i++) {
+            uint64_t on_ns = hal_host_on_ns(i);
+            on[i] = (double)(on_ns - last_on[i]) / (now - last_ns);
+            last_on[i] = on_ns;
+        }
+        plant_step(&plant, &plant_cfg, on, (now - last_ns) / 1e9);
+        if (plant.temp_c < plant_min) plant_min = plant.temp_c;
+        if (plant.temp_c > plant_max) plant_max = plant.temp_c;
+        plant_sum += plant.temp_c;
+        moist_sum += plant.moisture;
+        plant_steps++;
+        if (out != NULL && (uint64_t)(plant.time_s * 1000 + 0.5) % (PLANT_LOG_S * 1000) == 0)
+            fprintf(out, "plant %.0f %.2f %.3f %.2f\n", plant.time_s, plant.temp_c, plant.moisture, plant.sun);
+    }
+    last_ns = now;
+    plant_adc(&plant, &plant_cfg, hal_out_get(HAL_LIGHT), hal_host.adc);
+}
+
+// The simulation's own thread, above every firmware thread so it sees each
+// SIM_STEP_MS step before they do. Steps the plant model, and in virtual
+// time types the script into the console and collects the output until the
+// run is over.
+static void Sim_Thread(const void *arg) {
+    char line[256];
+    double at = -1;
+
+    while (1) {
+        uint64_t now = os_sim_now_ms(), wait = SIM_STEP_MS;
+        if (plant_on) plant_update();
+        if (run_ms == 0) {
+            osDelay(SIM_STEP_MS);
+            continue;
+        }
+        if (replaying) {
+            uint64_t next = replay_step(now);
+            if (next < wait) wait = next > 0 ? next : 1;
+        }
+        while (script != NULL) {
+            if (at < 0) {
+                if (fgets(line, sizeof(line), script) == NULL) break;
+                if (sscanf(line, "%lf", &at) != 1) continue; // Blank or comment
+            }
+            if (at * 1000 > now) break;
+            char *cmd = strchr(line, ' ');
+            if (cmd != NULL) hal_host_uart_feed(HAL_UART_CONSOLE, cmd + 1, strlen(cmd + 1));
+            at = -1;
+        }
+        drain(HAL_UART_CONSOLE);
+        drain(HAL_UART_RS485);
+        if (now >= run_ms) {
+            report();
+            if (out != NULL) fclose(out);
+            exit(0);
+        }
+        osDelay(wait);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *flash = NULL, *link = NULL;
+    char console[64], rs485[64];
+    pthread_t pump;
+    int opt;
+
+    hal_host.adc[0] = 2000;
+    hal_host.adc[1] = 2500;
+    hal_host.adc[2] = 3000;
+    plant_default_config(&plant_cfg);
+    while ((opt = getopt(argc, argv, "f:a:m:l:t:s:o:r:")) != -1) {
+        switch (opt) {
+            case 'f': flash = optarg; break;
+            case 'a': sscanf(optarg, "%d,%d,%d", &hal_host.adc[0], &hal_host.adc[1], &hal_host.adc[2]); break;
+            case 'm':
+                if (plant_set(&plant_cfg, optarg) != 0) return 2;
+                plant_on = 1;
+                break;
+            case 'l': link = optarg; break;
+            case 't': run_ms = (uint64_t)(atof(optarg) * 1000); break;
+            case 's':
+                if ((script = fopen(optarg, "r")) == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'r':
+                if (trace_open(&replay_trace, optarg) != 0) return 1;
+                trace_replay_init(&replay, &replay_trace);
+                replaying = 1;
+                break;
+            case 'o':
+                if ((out = fopen(optarg, "w")) == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-f flash.bin] [-a temp,moist,light | -m model] [-l link]\n"
+                                "       %s -t seconds [-s script] [-o out.txt] [-f flash.bin] [-a ... | -m model]\n"
+                                "       %s -r trace [-o out.txt] [-f flash.bin]\n",
+                        argv[0], argv[0], argv[0]);
+                return 2;
+        }
+    }
+
+    if (replaying && run_ms == 0) run_ms = UINT64_MAX; // Set once the trace is done
+    if (plant_on) {
+        plant_init(&plant, &plant_cfg);
+        plant_adc(&plant, &plant_cfg, 0, hal_host.adc);
+    }
+    if (run_ms > 0 || plant_on) os_sim_thread(Sim_Thread, osPriorityRealtime);
+    if (run_ms > 0) {
+        if (flash_sim_open(flash) != 0) return 1;
+        os_sim_virtual_time();
+        wall_start = wall_s();
+        return firmware_main(); // Sim_Thread ends the process
+    }
+
+    if (flash == NULL) flash = "greenhouse_flash.bin";
+    if (flash_sim_open(flash) != 0) return 1;
+    pty[HAL_UART_CONSOLE] = open_pty(link, "uart0", console, sizeof(console));
+    pty[HAL_UART_RS485] = open_pty(link, "rs485", rs485, sizeof(rs485));
+    if (pty[0] < 0 || pty[1] < 0) {
+        perror("pty");
+        return 1;
+    }
+    printf("UART0 on %s, RS-485 on %s, flash in %s\n", console, rs485, flash);
+    fflush(stdout);
+
+    pthread_create(&pump, NULL, uart_pump, NULL);
+    return firmware_main(); // Does not return once the kernel runs
+}
@@ -0,0 +1,214 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define RELEASE_BYTES (1 << 20)     // Pages given back behind the cursor in steps of this
+#define PREAMBLE_MS 500             // From the replay start to the first record
+#define POSTAMBLE_MS 2000           // From the last record to leaving replay mode, for the last scans to come back
+
+static const char *const preamble[] = { "SUB:SCAN:CHG", "SET:REPLAY:1" };
+static const char *const postamble[] = { "SET:REPLAY:0", "UNSUB:SCAN" };
+#define PREAMBLE_LINES 2
+
+int trace_open(TraceReader *r, const char *path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    const TraceHeader *h;
+
+    memset(r, 0, sizeof(*r));
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if (st.st_size < (off_t)sizeof(TraceHeader)) {
+        fprintf(stderr, "%s: not a trace\n", path);
+        close(fd);
+        return -1;
+    }
+    r->base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (r->base == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    r->size = st.st_size;
+    madvise((void *)r->base, r->size, MADV_SEQUENTIAL);
+    h = (const TraceHeader *)r->base;
+    if (h->magic != TRACE_MAGIC || h->version != TRACE_VERSION || h->header_size < sizeof(TraceHeader)) {
+        fprintf(stderr, "%s: not a version %d trace\n", path, TRACE_VERSION);
+        trace_close(r);
+        return -1;
+    }
+    r->pos = h->header_size;
+    return 0;
+}
+
+const TraceRecord *trace_next(TraceReader *r) {
+    const TraceRecord *rec;
+
+    if (r->pos + sizeof(TraceRecord) > r->size) return NULL;
+    rec = (const TraceRecord *)(r->base + r->pos);
+    if (r->pos + sizeof(TraceRecord) + rec->len > r->size) return NULL; // Cut short while recording
+    r->pos += sizeof(TraceRecord) + rec->len;
+    if (r->pos - r->released >= 2 * RELEASE_BYTES) { // Keep the record just returned mapped in
+        uint64_t end = (r->pos - RELEASE_BYTES) & ~(uint64_t)(RELEASE_BYTES - 1);
+        madvise((void *)(r->base + r->released), end - r->released, MADV_DONTNEED);
+        r->released = end;
+    }
+    return rec;
+}
+
+const char *trace_text(const TraceRecord *rec) {
+    return (const char *)(rec + 1);
+}
+
+void trace_close(TraceReader *r) {
+    if (r->base != NULL) munmap((void *)r->base, r->size);
+    r->base = NULL;
+}
+
+int trace_write_header(FILE *f) {
+    TraceHeader h = { TRACE_MAGIC, TRACE_VERSION, sizeof(TraceHeader) };
+    return fwrite(&h, sizeof(h), 1, f) == 1 ? 0 : -1;
+}
+
+int trace_write(FILE *f, const TraceRecord *rec, const char *text) {
+    static const char pad[4];
+    TraceRecord r = *rec;
+    int n = text != NULL ? strlen(text) : 0;
+
+    r.len = (n + 3) & ~3;
+    if (fwrite(&r, sizeof(r), 1, f) != 1 || fwrite(text, 1, n, f) != (size_t)n ||
+        fwrite(pad, 1, r.len - n, f) != (size_t)(r.len - n))
+        return -1;
+    return 0;
+}
+
+int trace_parse_scan(const char *line, TraceRecord *rec) {
+    unsigned seq, ms, t, m, l, act;
+    int end = 0;
+
+    if (sscanf(line, "SCAN:%u:%u:%u:%u:%u:%u%n", &seq, &ms, &t, &m, &l, &act, &end) != 6 || line[end] != '\0')
+        return 0;
+    memset(rec, 0, sizeof(*rec));
+    rec->type = TRACE_SCAN;
+    rec->seq = seq;
+    rec->ms = ms;
+    rec->adc[0] = t;
+    rec->adc[1] = m;
+    rec->adc[2] = l;
+    rec->act = act;
+    return 1;
+}
+
+int trace_parse_rx(const char *line, TraceRecord *rec, const char **text) {
+    unsigned seq;
+    int end = 0;
+
+    if (sscanf(line, "RX:%u:%n", &seq, &end) != 1 || end == 0) return 0;
+    memset(rec, 0, sizeof(*rec));
+    rec->type = TRACE_RX;
+    rec->seq = seq;
+    *text = line + end;
+    return 1;
+}
+
+void trace_replay_init(TraceReplay *p, TraceReader *trace) {
+    memset(p, 0, sizeof(*p));
+    p->trace = trace;
+    p->next = trace_next(trace);
+    if (p->next != NULL) p->first_ms = p->next->ms;
+}
+
+int trace_replay_line(TraceReplay *p, uint32_t elapsed_ms, char *line, int size, uint32_t *due_ms) {
+    const TraceRecord *rec = p->next;
+
+    if (p->stage < PREAMBLE_LINES) {
+        *due_ms = 0;
+        snprintf(line, size, "%s", preamble[p->stage++]);
+        return 1;
+    }
+    if (rec == NULL) {
+        *due_ms = p->last_due_ms + POSTAMBLE_MS;
+        if (p->stage >= 2 * PREAMBLE_LINES) return -1;
+        if (elapsed_ms < *due_ms) return 0;
+        snprintf(line, size, "%s", postamble[p->stage++ - PREAMBLE_LINES]);
+        return 1;
+    }
+    *due_ms = PREAMBLE_MS + (rec->ms - p->first_ms);
+    if (elapsed_ms < *due_ms) return 0;
+    p->last_due_ms = *due_ms;
+
+    if (rec->type == TRACE_SCAN) {
+        snprintf(line, size, "ADC:%u:%u:%u", rec->adc[0], rec->adc[1], rec->adc[2]);
+        if (p->pending_count == TRACE_PENDING) { // Never seen back
+            memmove(p->pending, p->pending + 1, (TRACE_PENDING - 1) * sizeof(p->pending[0]));
+            p->pending_count--;
+            p->missed++;
+        }
+        p->pending[p->pending_count++] = *rec;
+        p->scans++;
+    } else {
+        int n = rec->len < size - 1 ? rec->len : size - 1;
+        memcpy(line, trace_text(rec), n);
+        line[n] = '\0';
+        line[strnlen(line, n)] = '\0'; // Drop the padding
+        p->commands++;
+    }
+    p->next = trace_next(p->trace);
+    return 1;
+}
+
+// A replayed scan carries the values sent for it; scans sent before the one
+// seen and not seen themselves were lost on the way
+void trace_replay_output(TraceReplay *p, const char *line) {
+    TraceRecord got;
+    int i;
+
+    if (!trace_parse_scan(line, &got)) return;
+    for (i = 0; i < p->pending_count; i++) {
+        if (memcmp(p->pending[i].adc, got.adc, sizeof(got.adc)) == 0) break;
+    }
+    if (i == p->pending_count) return; // Not a replayed scan
+    if (p->matched + p->missed + i > 0) { // The first has what came before the trace in it
+        const TraceRecord *want = &p->pending[i];
+        int diff = (want->act ^ got.act) & 7;
+
+        p->compared++;
+        for (int a = 0; a < 3; a++) {
+            if (diff & (1 << a)) p->differ[a]++;
+        }
+        if (diff && p->differing++ == 0) {
+            p->first_differ_seq = want->seq;
+            p->first_differ_want = want->act;
+            p->first_differ_got = got.act;
+        }
+    }
+    p->matched++;
+    p->missed += i;
+    memmove(p->pending, p->pending + i + 1, (p->pending_count - i - 1) * sizeof(p->pending[0]));
+    p->pending_count -= i + 1;
+}
+
+void trace_replay_report(const TraceReplay *p, FILE *f) {
+    static const char *const name[3] = { "heater", "sprinkler", "light" };
+
+    fprintf(f, "replayed %llu scans and %llu commands, %llu scans seen back, %llu lost\n",
+            (unsigned long long)p->scans, (unsigned long long)p->commands, (unsigned long long)p->matched,
+            (unsigned long long)(p->missed + p->pending_count));
+    for (int a = 0; a < 3; a++) {
+        fprintf(f, "%-9s differs at %llu of %llu scans\n", name[a], (unsigned long long)p->differ[a],
+                (unsigned long long)p->compared);
+    }
+    if (p->differing) {
+        fprintf(f, "first difference at recorded scan %u: actuators %x, recorded %x\n",
+                p->first_differ_seq, p->first_differ_got, p->first_differ_want);
+    } else {
+        fprintf(f, "actuator states match the recording at every scan\n");
+    }
+}
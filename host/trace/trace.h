@@ -0,0 +1,102 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Sensor traces recorded from a board, in trace.c. The firmware numbers its
+// scans and, with SUB:SCAN:CHG, sends each as
+//   SCAN:<seq>:<ms>:<temp>:<moist>:<light>:<actuator bits>
+// and echoes console input as RX:<seq of the scan before>:<line>. A trace
+// file is a TraceHeader and then records in scan order, each command after
+// the scan it followed. The records are packed for reading straight out of
+// a memory-mapped file, host byte order.
+//
+// The actuator bits of a scan are the actuators that were on at some point
+// since the scan before, the outcome of the decisions taken in between.
+//
+// Replay sends the trace back to a board, or the simulation, in replay mode
+// (SET:REPLAY:1): each scan as an ADC command at its recorded time, each
+// command as it was. The firmware reports its replayed scans on the same
+// stream, and their actuator bits are checked against the recording from
+// the second scan on, so a decision that comes out differently shows as the
+// first scan where the two part.
+
+#define TRACE_MAGIC 0x52544847      // "GHTR"
+#define TRACE_VERSION 1
+#define TRACE_LINE 64               // Console line buffer on the board
+
+enum { TRACE_SCAN, TRACE_RX };
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;           // Records start here
+} TraceHeader;
+
+typedef struct {
+    uint32_t seq;                   // Scan number on the board, or the scan a command followed
+    uint32_t ms;                    // Board time of that scan
+    uint8_t type;                   // TRACE_
+    uint8_t act;                    // TRACE_SCAN: actuator bits, see above
+    uint16_t len;                   // TRACE_RX: bytes of the line that follows, padded to 4
+    uint16_t adc[3];                // TRACE_SCAN: temperature, moisture, light
+    uint16_t reserved;
+} TraceRecord;
+
+typedef struct {
+    const uint8_t *base;            // The mapped file
+    uint64_t size;
+    uint64_t pos;                   // Offset of the next record
+    uint64_t released;              // Mapped pages before this were given back
+} TraceReader;
+
+// Maps a trace, 0 on success. Pages are read in as the cursor reaches them
+// and given back behind it, so a trace of any size streams in bounded memory.
+int trace_open(TraceReader *r, const char *path);
+const TraceRecord *trace_next(TraceReader *r);  // NULL at the end
+const char *trace_text(const TraceRecord *rec); // TRACE_RX line, not terminated
+void trace_close(TraceReader *r);
+
+int trace_write_header(FILE *f);
+int trace_write(FILE *f, const TraceRecord *rec, const char *text);
+
+// Parses a SCAN line without its newline into rec, 1 if it is one
+int trace_parse_scan(const char *line, TraceRecord *rec);
+// Parses an RX line, rec gets the seq and *text the command. 1 if it is one.
+int trace_parse_rx(const char *line, TraceRecord *rec, const char **text);
+
+// The replay side. Feed it every line the board sends; it gives the lines
+// to send it, each when the board clock the trace started at has reached
+// its time, and compares the replayed scans with the recorded ones.
+#define TRACE_PENDING 16            // Scans sent and not yet seen back
+
+typedef struct {
+    TraceReader *trace;
+    const TraceRecord *next;        // Next record to send, NULL when all are
+    uint32_t first_ms;              // Board time of the first record
+    uint32_t last_due_ms;           // When the last record sent was due
+    int stage;                      // Preamble lines sent so far
+    TraceRecord pending[TRACE_PENDING];
+    int pending_count;
+    uint64_t scans, commands;       // Sent
+    uint64_t matched, missed;       // Replayed scans seen back; sent but never reported
+    uint64_t differ[3];             // Replayed scans where actuator n was not as recorded
+    uint64_t compared;
+    uint64_t differing;             // Scans with any difference
+    uint32_t first_differ_seq;      // Recorded seq of the first one, when differing
+    uint8_t first_differ_want, first_differ_got;
+} TraceReplay;
+
+void trace_replay_init(TraceReplay *p, TraceReader *trace);
+
+// Copies the next line to send into line if it is due at elapsed_ms since
+// the replay started. Returns 1 if it did, 0 if it is not due yet, -1 when
+// the trace is done and the board has been given time to report the last
+// scans and taken out of replay mode. *due_ms gets when the next line is due.
+int trace_replay_line(TraceReplay *p, uint32_t elapsed_ms, char *line, int size, uint32_t *due_ms);
+
+void trace_replay_output(TraceReplay *p, const char *line); // A line from the board, no newline
+void trace_replay_report(const TraceReplay *p, FILE *f);
+
+#endif
@@ -0,0 +1,250 @@
+// Records sensor traces from a board's console and replays them to a board
+// in replay mode, see trace.h. While recording, lines typed on stdin go to
+// the board, which echoes them into the trace, and everything the board
+// sends besides the trace is printed. The settings the decisions depend on
+// are read first and put at the head of the trace, so a replay starts from
+// them. Recording ends after <seconds> or on Ctrl-C.
+//
+//   gcc -O2 tracer.c trace.c -o tracer
+//   ./tracer rec /dev/ttyUSB0 site.trace [seconds]
+//   ./tracer play /dev/ttyUSB0 site.trace
+//   ./tracer dump site.trace
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define BAUD B9600              // UART0, CONSOLE_DLL in hal_lpc17xx.h
+#define REPLY_MS 1000           // Wait for each settings reply
+#define DRAIN_MS 500            // Wait for the last replies
+
+// Settings the control decisions depend on
+static const char *const settings[] = {
+    "AUTO", "HEATER_TH", "SPRINKLER_TH", "LIGHT_TH", "HEATER_DUR", "SPRINKLER_DUR", "LIGHT_DUR", "SENSOR_RATE"
+};
+#define SETTINGS (int)(sizeof(settings) / sizeof(settings[0]))
+
+typedef struct {
+    int fd;
+    char buf[512];
+    int len;
+} Serial;
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    stop = 1;
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int serial_open(Serial *s, const char *path) {
+    struct termios tio;
+
+    s->len = 0;
+    s->fd = open(path, O_RDWR | O_NOCTTY);
+    if (s->fd < 0 || tcgetattr(s->fd, &tio) < 0) {
+        perror(path);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, BAUD);
+    cfsetospeed(&tio, BAUD);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(s->fd, TCSANOW, &tio);
+    tcflush(s->fd, TCIOFLUSH);
+    return 0;
+}
+
+static void serial_send(Serial *s, const char *line) {
+    if (write(s->fd, line, strlen(line)) < 0 || write(s->fd, "\n", 1) < 0) perror("write");
+}
+
+// Next complete line from the board without its line end, waiting until
+// deadline. Returns 1 with a line, 0 on timeout or when stdin (if watched)
+// has input.
+static int serial_line(Serial *s, char *line, int size, uint64_t deadline, int watch_stdin) {
+    while (1) {
+        char *nl = memchr(s->buf, '\n', s->len);
+        if (nl != NULL) {
+            int n = nl - s->buf, copy = n < size - 1 ? n : size - 1;
+            memcpy(line, s->buf, copy);
+            line[copy] = '\0';
+            if (copy > 0 && line[copy - 1] == '\r') line[copy - 1] = '\0';
+            s->len -= n + 1;
+            memmove(s->buf, nl + 1, s->len);
+            return 1;
+        }
+        if (s->len == sizeof(s->buf)) s->len = 0; // Garbage without newline
+
+        uint64_t now = now_ms();
+        if (now >= deadline || stop) return 0;
+        struct timeval tv = { (deadline - now) / 1000, (deadline - now) % 1000 * 1000 };
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(s->fd, &fds);
+        if (watch_stdin) FD_SET(0, &fds);
+        if (select(s->fd + 1, &fds, NULL, NULL, &tv) <= 0) continue;
+        if (watch_stdin && FD_ISSET(0, &fds)) return 0;
+        int n = read(s->fd, s->buf + s->len, sizeof(s->buf) - s->len);
+        if (n > 0) s->len += n;
+    }
+}
+
+static int record(const char *dev, const char *path, double seconds) {
+    Serial s;
+    FILE *out;
+    char line[256], cmd[TRACE_LINE];
+    char setting[SETTINGS][TRACE_LINE];
+    TraceRecord rx[32];             // Commands echoed ahead of the scan they follow
+    const char *text;
+    char rx_text[32][TRACE_LINE];
+    int nset = 0, nrx = 0, stdin_open = 1;
+    uint64_t scans = 0, commands = 0, gaps = 0, end;
+    uint32_t last_seq = 0;
+    TraceRecord rec;
+
+    if (serial_open(&s, dev) != 0) return 1;
+    if ((out = fopen(path, "wb")) == NULL || trace_write_header(out) != 0) {
+        perror(path);
+        return 1;
+    }
+    for (int i = 0; i < SETTINGS; i++) {
+        char want[32];
+        uint64_t deadline = now_ms() + REPLY_MS;
+
+        snprintf(cmd, sizeof(cmd), "GET:%s", settings[i]);
+        serial_send(&s, cmd);
+        snprintf(want, sizeof(want), "ACK:%s:", settings[i]);
+        while (serial_line(&s, line, sizeof(line), deadline, 0)) {
+            if (strncmp(line, want, strlen(want)) != 0) continue;
+            snprintf(setting[nset++], TRACE_LINE, "SET:%s:%s", settings[i], line + strlen(want));
+            break;
+        }
+    }
+    fprintf(stderr, "read %d of %d settings\n", nset, SETTINGS);
+    serial_send(&s, "SUB:SCAN:CHG");
+
+    signal(SIGINT, on_signal);
+    end = seconds > 0 ? now_ms() + (uint64_t)(seconds * 1000) : UINT64_MAX;
+    while (!stop && now_ms() < end) {
+        if (!serial_line(&s, line, sizeof(line), end < now_ms() + 1000 ? end : now_ms() + 1000, stdin_open)) {
+            fd_set fds;
+            struct timeval tv = { 0, 0 };
+            FD_ZERO(&fds);
+            FD_SET(0, &fds);
+            if (stdin_open && select(1, &fds, NULL, NULL, &tv) > 0) {
+                if (fgets(cmd, sizeof(cmd), stdin) == NULL) {
+                    stdin_open = 0;
+                } else {
+                    cmd[strcspn(cmd, "\r\n")] = '\0';
+                    serial_send(&s, cmd);
+                }
+            }
+            continue;
+        }
+        if (trace_parse_rx(line, &rec, &text)) {
+            if (nrx < 32) {
+                rx[nrx] = rec;
+                snprintf(rx_text[nrx++], TRACE_LINE, "%s", text);
+            }
+            continue;
+        }
+        if (!trace_parse_scan(line, &rec)) {
+            printf("%s\n", line);
+            fflush(stdout);
+            continue;
+        }
+        if (scans == 0) { // The settings go ahead of the first scan, at its time
+            for (int i = 0; i < nset; i++) {
+                TraceRecord set = { rec.seq - 1, rec.ms, TRACE_RX };
+                trace_write(out, &set, setting[i]);
+            }
+        } else if (rec.seq != last_seq + 1) {
+            gaps++;
+        }
+        // Commands that came after an earlier scan go first, they may have
+        // been echoed before that scan's line was sent
+        for (int i = 0; i < nrx; i++) {
+            if (rx[i].seq >= rec.seq) continue;
+            rx[i].ms = rec.ms;
+            trace_write(out, &rx[i], rx_text[i]);
+            commands++;
+            memmove(&rx[i], &rx[i + 1], (nrx - i - 1) * sizeof(rx[0]));
+            memmove(rx_text[i], rx_text[i + 1], (nrx - i - 1) * sizeof(rx_text[0]));
+            nrx--, i--;
+        }
+        trace_write(out, &rec, NULL);
+        scans++;
+        last_seq = rec.seq;
+    }
+    serial_send(&s, "UNSUB:SCAN");
+    fclose(out);
+    fprintf(stderr, "recorded %llu scans and %llu commands, %llu gaps in the scan numbers\n",
+            (unsigned long long)scans, (unsigned long long)commands, (unsigned long long)gaps);
+    return 0;
+}
+
+static int play(const char *dev, const char *path) {
+    Serial s;
+    TraceReader r;
+    TraceReplay p;
+    char line[256];
+    uint64_t start, drain_end = 0;
+    uint32_t due;
+    int state;
+
+    if (serial_open(&s, dev) != 0 || trace_open(&r, path) != 0) return 1;
+    trace_replay_init(&p, &r);
+    signal(SIGINT, on_signal);
+    start = now_ms();
+    while (!stop) {
+        uint64_t elapsed = now_ms() - start;
+
+        while ((state = trace_replay_line(&p, elapsed, line, TRACE_LINE, &due)) == 1) serial_send(&s, line);
+        if (state < 0 && drain_end == 0) drain_end = now_ms() + DRAIN_MS;
+        if (drain_end != 0 && now_ms() >= drain_end) break;
+        if (serial_line(&s, line, sizeof(line), state < 0 ? drain_end : start + due, 0))
+            trace_replay_output(&p, line);
+    }
+    trace_replay_report(&p, stdout);
+    trace_close(&r);
+    return p.differing != 0;
+}
+
+static int dump(const char *path) {
+    TraceReader r;
+    const TraceRecord *rec;
+
+    if (trace_open(&r, path) != 0) return 1;
+    while ((rec = trace_next(&r)) != NULL) {
+        if (rec->type == TRACE_SCAN) {
+            printf("SCAN:%u:%u:%u:%u:%u:%u\n", rec->seq, rec->ms, rec->adc[0], rec->adc[1], rec->adc[2], rec->act);
+        } else {
+            printf("RX:%u:%.*s\n", rec->seq, (int)strnlen(trace_text(rec), rec->len), trace_text(rec));
+        }
+    }
+    trace_close(&r);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 4 && strcmp(argv[1], "rec") == 0) return record(argv[2], argv[3], argc > 4 ? atof(argv[4]) : 0);
+    if (argc == 4 && strcmp(argv[1], "play") == 0) return play(argv[2], argv[3]);
+    if (argc == 3 && strcmp(argv[1], "dump") == 0) return dump(argv[2]);
+    fprintf(stderr, "usage: %s rec <device> <trace> [seconds]\n"
+                    "       %s play <device> <trace>\n"
+                    "       %s dump <trace>\n", argv[0], argv[0], argv[0]);
+    return 2;
+}
@@ -0,0 +1,104 @@
+#include "cmsis_os.h"
+#include "hal.h"
+#include "joystick.h"
+
+#define KEY_COUNT 5
+
+static uint8_t integrator[KEY_COUNT];
+static uint16_t held[KEY_COUNT];        // ms since the press, saturating
+static uint16_t next_repeat[KEY_COUNT];
+static volatile uint32_t keys_down;
+
+static int repeat_interval(int held_ms) {
+    if (held_ms >= JOY_FASTER_MS) return JOY_REPEAT_MS / 4;
+    if (held_ms >= JOY_FAST_MS) return JOY_REPEAT_MS / 2;
+    return JOY_REPEAT_MS;
+}
+
+volatile uint32_t joy_dropped;
+volatile int joy_test_hz;
+
+osMailQDef(joy_mail, JOY_QUEUE_LEN, JoyEvent);
+static osMailQId joy_queue;
+
+static void post(int key, int type, int held_ms) {
+    JoyEvent *ev = osMailAlloc(joy_queue, 0);
+    if (ev == NULL) {
+        joy_dropped++;
+        return;
+    }
+    ev->key = 1 << key;
+    ev->type = type;
+    ev->held_ms = held_ms;
+    osMailPut(joy_queue, ev);
+}
+
+// Keys held by the joy_test_hz press generator at this sample
+static uint32_t test_keys(void) {
+    static uint32_t ms, presses;
+    int hz = joy_test_hz;
+
+    if (hz <= 0) return 0;
+    ms += JOY_SAMPLE_MS;
+    if (ms >= 1000 / hz) {
+        ms = 0;
+        presses++;
+    }
+    return ms < JOY_TEST_HOLD_MS ? (presses & 1 ? KEY_UP : KEY_DOWN) : 0;
+}
+
+// Runs in the RTX timer thread every JOY_SAMPLE_MS
+static void Joystick_Timer(const void *arg) {
+    uint32_t keys = hal_keys() | test_keys();
+
+    for (int k = 0; k < KEY_COUNT; k++) {
+        uint32_t bit = 1 << k;
+
+        if (keys & bit) {
+            if (integrator[k] < JOY_INTEGRATOR) integrator[k]++;
+        } else if (integrator[k] > 0) {
+            integrator[k]--;
+        }
+
+        if (!(keys_down & bit)) {
+            if (integrator[k] == JOY_INTEGRATOR) {
+                keys_down |= bit;
+                held[k] = 0;
+                next_repeat[k] = JOY_REPEAT_DELAY_MS;
+                post(k, JOY_PRESS, 0);
+            }
+            continue;
+        }
+        if (integrator[k] == 0) {
+            keys_down &= ~bit;
+            post(k, JOY_RELEASE, held[k]);
+            continue;
+        }
+        if (held[k] < 0xFFFF - JOY_SAMPLE_MS) held[k] += JOY_SAMPLE_MS;
+        if (held[k] >= JOY_LONG_MS && held[k] < JOY_LONG_MS + JOY_SAMPLE_MS) post(k, JOY_LONG, held[k]);
+        if (held[k] >= next_repeat[k] && next_repeat[k] < 0xFFFF - JOY_REPEAT_MS) {
+            next_repeat[k] += repeat_interval(held[k]);
+            post(k, JOY_REPEAT, held[k]);
+        }
+    }
+}
+
+osTimerDef(Joystick_Timer, Joystick_Timer);
+
+void joystick_init(void) {
+    hal_keys_init();
+    joy_queue = osMailCreate(osMailQ(joy_mail), NULL);
+    osTimerStart(osTimerCreate(osTimer(Joystick_Timer), osTimerPeriodic, NULL), JOY_SAMPLE_MS);
+}
+
+int joystick_get(JoyEvent *ev, uint32_t timeout) {
+    osEvent evt = osMailGet(joy_queue, timeout);
+    if (evt.status != osEventMail) return 0;
+    *ev = *(JoyEvent *)evt.value.p;
+    osMailFree(joy_queue, evt.value.p);
+    return 1;
+}
+
+uint32_t joystick_state(void) {
+    return keys_down;
+}
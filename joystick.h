@@ -0,0 +1,59 @@
+#ifndef JOYSTICK_H
+#define JOYSTICK_H
+
+#include <stdint.h>
+
+// Joystick driver. A periodic RTX timer samples the five switches every
+// JOY_SAMPLE_MS, debounces each one with an integrator and posts events to
+// a mail queue, so the UI blocks in joystick_get() instead of polling.
+//
+//   JOY_PRESS    debounced press
+//   JOY_REPEAT   key still held, first after JOY_REPEAT_DELAY_MS then every
+//                JOY_REPEAT_MS, twice as often after JOY_FAST_MS and four
+//                times as often after JOY_FASTER_MS
+//   JOY_LONG     once, when a key has been held for JOY_LONG_MS
+//   JOY_RELEASE  debounced release
+
+#define KEY_UP     0x01         // P1.23
+#define KEY_DOWN   0x02         // P1.25
+#define KEY_CENTER 0x04         // P1.20
+#define KEY_LEFT   0x08         // P1.24
+#define KEY_RIGHT  0x10         // P1.26
+
+#define JOY_SAMPLE_MS 5
+#define JOY_INTEGRATOR 4        // Samples to agree on a new state, 20 ms
+#define JOY_REPEAT_DELAY_MS 400
+#define JOY_REPEAT_MS 100
+#define JOY_FAST_MS 1500
+#define JOY_FASTER_MS 3000
+#define JOY_LONG_MS 1000
+#define JOY_QUEUE_LEN 8         // Events beyond this are dropped and counted
+#define JOY_TEST_MAX_HZ 10      // Synthetic presses, see joy_test_hz
+#define JOY_TEST_HOLD_MS 40     // Each one held this long, twice the debounce
+
+enum { JOY_PRESS, JOY_REPEAT, JOY_LONG, JOY_RELEASE };
+
+typedef struct {
+    uint8_t key;                // One KEY_ bit
+    uint8_t type;               // JOY_PRESS ...
+    uint16_t held_ms;           // Time the key has been down, 0 for JOY_PRESS
+} JoyEvent;
+
+void joystick_init(void);
+
+// Waits up to timeout ms (osWaitForever allowed) for the next event.
+// Returns 1 and fills ev, or 0 on timeout.
+int joystick_get(JoyEvent *ev, uint32_t timeout);
+
+uint32_t joystick_state(void);  // Debounced KEY_ bits currently down
+
+extern volatile uint32_t joy_dropped;
+
+// Synthetic key presses per second for load tests, 0 for none. They
+// alternate Up and Down and go through the debouncer like real ones, so the
+// UI does the work of a user scrolling on whatever screen is open. Value
+// editors ignore Up and Down while they run, so a test never changes or
+// saves a setting.
+extern volatile int joy_test_hz;
+
+#endif
@@ -1,17 +1,13 @@
-#include <LPC17xx.h>
 #include "cmsis_os.h"
-#include "Board_LED.h"
-#include "Board_GLCD.h"
-#include <stdio.h>
 #include <string.h>
-
-#define JOYSTICK_UP_PIN     (1 << 23)  // P1.23
-#define JOYSTICK_DOWN_PIN   (1 << 25)  // P1.25
-#define JOYSTICK_CENTER_PIN (1 << 20)  // P1.20
-#define JOYSTICK_LEFT_PIN   (1 << 24)  // P1.24
-#define JOYSTICK_RIGHT_PIN  (1 << 26)  // P1.26
-
-extern GLCD_FONT GLCD_Font_16x24;
+#include "hal.h"
+#include "fmt.h"
+#include "rs485_proto.h"
+#include "joystick.h"
+#include "cfg_store.h"
+#include "flash_iap.h"
+#include "sample_log.h"
+#include "crash.h"
 
 #define White 0xFFFFFF
 #define Black 0x000000
@@ -20,10 +16,8 @@ extern GLCD_FONT GLCD_Font_16x24;
 #define Green 0x00FF00
 
 // Function Prototypes
-void ADC_Init(void);
-void GPIO_Init(void);
-void UART0_Init(void);
 void UART0_SendString(const char *str);
+void UART1_SendString(const char *str);
 void Sensor_Thread(const void *arg);
 void UART_Thread(const void *arg);
 void HeaterMonitor_Thread(const void *arg);
@@ -33,24 +27,30 @@ void SprinklerControl_Thread(const void *arg);
 void LightMonitor_Thread(const void *arg);
 void LightControl_Thread(const void *arg);
 void UART_ReceiveThread(const void *arg);
+void RS485_Thread(const void *arg);
 void Menu_Thread(const void *arg);
-void Menu_Display(int prev_selected_menu);
-void actuator_control(void);
-void show_sensors_on_glcd(void);
-void toggle_gpio(int actuator);
-int Read_ADC(int channel);
-void adjustHeaterThreshold(void);
-void adjustSprinklerThreshold(void);
-void adjustLightThreshold(void);
+void Render_Thread(const void *arg);
+void Config_Thread(const void *arg);
+void show_trend_graph(void);
+int actuator_is_on(int actuator);
+void actuator_set(int actuator, int on);
+void Command_Execute(char *line, void (*reply)(const char *));
+void History_Append(void);
+void Log_Append(void);
+void Stream_Wake(void);
 
 // Global Variables
 osMutexId adc_mutex;
 osMutexId glcd_mutex;
+osMutexId uart_mutex;
+osMutexId ui_mutex;
+osMutexId log_mutex;
 osSemaphoreId heater_sem;
 osSemaphoreId sprinkler_sem;
 osSemaphoreId light_sem;
 
 volatile int temp_adc, moist_adc, light_adc;
+volatile int temp_filt, moist_filt, light_filt; // Smoothed readings, see FILTER_SHIFT
 volatile int threadHoldtemp_adc = 1600;   // Heater threshold
 volatile int threadHoldmoist_adc = 5000;  // Sprinkler threshold
 volatile int threadHoldlight_adc = 4091;  // Light threshold
@@ -59,104 +59,568 @@ volatile int Heater_ON_Duration = 500;   // Heater ON Duration
 volatile int sprinkler_ON_Duration = 600;  // Sprinkler ON Duration
 volatile int light_ON_Duration = 700;  // Light ON Duration
 
-int selected_menu = 0;
+volatile int sensor_period_ms = 1000;     // Sensor sampling period
+volatile int telemetry_period_ms = 3000;  // UART telemetry period
+volatile int auto_mode = 1;               // 1: monitor threads drive actuators, 0: manual only
+volatile int history_period_s = 30;       // Seconds between history samples
+volatile int uptime_s;                    // Seconds since boot, kept by Uptime_Timer
+volatile int node_address;                // RS-485 node address, 0 keeps the node off the bus
+volatile int idle_dim_s = 60;             // Seconds without joystick input before dimming, 0 never
+volatile int idle_off_s = 300;            // Seconds without input before the panel blanks, 0 never
+volatile int replay_mode;                 // 1: Sensor_Thread takes its scans from ADC commands
+
+// Load figures refreshed once a second by Uptime_Timer
+extern volatile uint32_t os_idle_cycles;  // Counted by os_idle_demon in RTX_Conf_CM.c
+volatile uint32_t glcd_bytes;             // Estimated SPI bytes sent to the panel
+volatile int cpu_load_pct;                // Share of the last second not spent idle
+volatile int glcd_bps;                    // Panel SPI bytes in the last second
+volatile int frame_us;                    // Time the last UI frame took to draw
+volatile int frame_overruns;              // Frames over FRAME_BUDGET_US since boot
+volatile int cfg_saves;                   // Settings records written to flash since boot
+volatile int log_time_s;                  // Sample log clock, see LOG_SECTOR
+volatile int crash_records;               // Crash records in flash, counted at boot
+
+// Panel geometry and SPI cost estimates. A glyph is 16x24 RGB565 pixels plus
+// the window setup commands that precede it.
+#define GLCD_WIDTH HAL_DISPLAY_WIDTH
+#define GLCD_HEIGHT HAL_DISPLAY_HEIGHT
+#define GLCD_COLS (GLCD_WIDTH / 16)
+#define GLCD_WINDOW_BYTES 32
+#define GLCD_GLYPH_BYTES (16 * 24 * 2 + GLCD_WINDOW_BYTES)
+#define GLCD_SCREEN_BYTES (GLCD_WIDTH * GLCD_HEIGHT * 2 + GLCD_WINDOW_BYTES)
+
+// Sample history, a ring of the last HISTORY_LEN samples guarded by adc_mutex.
+// history_seq counts every sample ever stored, so sample n lives at
+// history[n % HISTORY_LEN] while n >= history_seq - HISTORY_LEN.
+#define HISTORY_LEN 600   // 5 hours at the default 30 s period
+#define HISTORY_CHUNK 8   // Samples sent per DUMP request
+
+typedef struct {
+    uint32_t time_s;      // Uptime when the sample was taken
+    uint16_t temp, moist, light;
+} HistorySample;
+
+HistorySample history[HISTORY_LEN];
+uint32_t history_seq;
+
+// Every history sample is also kept, compressed, in the flash sample log in
+// sectors 24-27, about two weeks at the default period. The log has its own
+// clock: log_time_s carries on from the newest logged sample after a reset,
+// so log times only ever increase. Guarded by log_mutex.
+//
+// Samples wait in a RAM block until it fills a flash page, about an hour at
+// the default period, and a block is written out early once its first
+// sample is LOG_FLUSH_S old. Nothing is written on the way down through a
+// reset, a crash or a power loss, so one loses at most LOG_FLUSH_S plus one
+// history period of samples.
+#define LOG_SECTOR 24
+#define LOG_SECTORS 4
+#define LOG_BASE 0x00050000
+#define LOG_FLUSH_S 3600
+
+#define FILTER_SHIFT 3    // Exponential smoothing weight of 1/8 per new sample
+#define ADC_MAX 4095      // Full-scale 12-bit reading
+
+// Fault flags, reported on the FAULT stream
+#define FAULT_TEMP_SENSOR   0x01  // Reading pinned at a rail, sensor open or shorted
+#define FAULT_MOIST_SENSOR  0x02
+#define FAULT_LIGHT_SENSOR  0x04
+#define FAULT_UART_RX       0x08  // Overrun or framing error seen on UART0
+#define FAULT_CONFIG        0x10  // Settings could not be saved to flash
+#define FAULT_LOG           0x20  // A sample log block could not be written
+volatile int fault_flags;
+
+// Per-thread loop counters, reported on the STATS stream
+enum {
+    STAT_SENSOR, STAT_UART, STAT_HEATER_MON, STAT_HEATER_CTL, STAT_SPRINKLER_MON,
+    STAT_SPRINKLER_CTL, STAT_LIGHT_MON, STAT_LIGHT_CTL, STAT_UART_RX, STAT_MENU, STAT_RS485, STAT_RENDER,
+    STAT_COUNT
+};
+volatile uint32_t thread_loops[STAT_COUNT];
+
+// Boot profile. main() forces the actuators off before anything else, the
+// control threads are created first and the panel comes up at low priority
+// behind them. Each stage records microseconds since main() once, and
+// UART_Thread reports it as BOOT:<stage>:<us>.
+enum { BOOT_KERNEL, BOOT_SAMPLE, BOOT_DECIDE, BOOT_PANEL, BOOT_STAGES };
+static const char *const boot_names[BOOT_STAGES] = { "KERNEL", "SAMPLE", "DECIDE", "PANEL" };
+volatile int boot_us[BOOT_STAGES];
+
+static void boot_mark(int stage) {
+    if (boot_us[stage]) return;
+    boot_us[stage] = hal_us() + 1; // Never 0 once reached
+    Stream_Wake();
+}
 
-uint32_t lastJoystickState = 0;
-uint32_t lastActionTime = 0;
-#define DEBOUNCE_TIME 100
+// Monitor threads hold their first decision until there is a real reading
+static void wait_first_sample(void) {
+    while (!boot_us[BOOT_SAMPLE]) osDelay(1);
+}
 
-void ADC_Init(void) {
-    LPC_PINCON->PINSEL1 |= (1 << 14) | (1 << 16) | (1 << 18); // Configure AD0.00.2 (P0.2325)
-    LPC_SC->PCONP |= (1 << 12); // Enable ADC power
-    LPC_ADC->ADCR = (7 << 0) | (4 << 8) | (1 << 21); // Enable 3 channels, set clock division, power ON
+osThreadId sensor_thread_id;
+osThreadId uart_thread_id;
+osThreadId render_thread_id;
+osThreadId config_thread_id;
+
+// Millisecond clock from the kernel tick counter. That counts at OS_CLOCK
+// and wraps every 2^32 / OS_CLOCK seconds, 358 s at the 12 MHz set in
+// RTX_Conf_CM.c. One per thread, each must read its own at least that
+// often; a clock starting at { 0, 0 } counts from the kernel start.
+typedef struct {
+    uint32_t last_tick, ms;
+} MsClock;
+
+static uint32_t ms_clock(MsClock *c) {
+    const uint32_t tick_per_ms = osKernelSysTickMicroSec(1000);
+    uint32_t elapsed = (osKernelSysTick() - c->last_tick) / tick_per_ms;
+    c->last_tick += elapsed * tick_per_ms;
+    c->ms += elapsed;
+    return c->ms;
 }
 
-void GPIO_Init(void) {
-    LPC_GPIO1->FIODIR |= (1 << 29) | (1 << 31) | (1 << 28); // Set P1.29 (heater), P1.31 (sprinkler), P1.28 (status LED) as outputs
-    LPC_GPIO2->FIODIR |= (1 << 2); // Set P2.2 (light) as output
+#define RS485_TURNAROUND_MS 2     // Pause before answering so the host can release the bus
+
+void UART1_SendString(const char *str) {
+    while (*str) hal_uart_putc(HAL_UART_RS485, *str++);
 }
 
-void GPIO_Joystick_Init(void) {
-    LPC_PINCON->PINSEL3 &= ~((3 << 14) | (3 << 18) | (3 << 8) | (3 << 16) | (3 << 20)); // Set P1.23, P1.24, P1.25, P1.26, P1.20 to GPIO
-    LPC_PINCON->PINMODE3 &= ~((3 << 14) | (3 << 18) | (3 << 8) | (3 << 16) | (3 << 20)); // Enable pull-up resistors
-    LPC_GPIO1->FIODIR &= ~(JOYSTICK_UP_PIN | JOYSTICK_DOWN_PIN | JOYSTICK_CENTER_PIN | JOYSTICK_LEFT_PIN | JOYSTICK_RIGHT_PIN); // Set as input
+void UART0_SendString(const char *str) {
+    while (*str) hal_uart_putc(HAL_UART_CONSOLE, *str++);
 }
 
-uint32_t readJoystick(void) {
-    uint32_t state = 0;
-    if (!(LPC_GPIO1->FIOPIN & JOYSTICK_UP_PIN))     state |= 0x01;
-    if (!(LPC_GPIO1->FIOPIN & JOYSTICK_DOWN_PIN))   state |= 0x02;
-    if (!(LPC_GPIO1->FIOPIN & JOYSTICK_CENTER_PIN)) state |= 0x04;
-    if (!(LPC_GPIO1->FIOPIN & JOYSTICK_LEFT_PIN))   state |= 0x08;
-    if (!(LPC_GPIO1->FIOPIN & JOYSTICK_RIGHT_PIN))  state |= 0x10;
-    return state;
+static int sensor_fault(int value) {
+    return value == 0 || value == 0xFFF;
 }
 
-void UART0_Init(void) {
-    LPC_SC->PCONP |= (1 << 3); // Power up UART0
-    LPC_PINCON->PINSEL0 |= (1 << 4) | (1 << 6); // Configure P0.2 as TXD0 and P0.3 as RXD0
-    LPC_UART0->LCR = 0x83; // 8 bits, 1 stop bit, enable DLAB
-    LPC_UART0->DLM = 0; LPC_UART0->DLL = 97; // Set baud rate to 9600
-    LPC_UART0->LCR = 0x03; // 8 bits, 1 stop bit, no parity
+// Trace of the acquisitions for record and replay. Each scan is numbered,
+// stamped with the actuators that were on since the scan before, and goes
+// out on the SCAN stream from a ring, so UART_Thread never waits on
+// adc_mutex for it; console commands are echoed as RX lines between the
+// scans they came after. In replay mode (SET:REPLAY:1, not saved)
+// Sensor_Thread waits for ADC commands instead of reading the ADC, so the
+// same scans can be fed back on a bench board, or in the host simulation.
+// Replayed scans are not kept in the history or the flash sample log.
+#define REPLAY_SCAN 0x01          // Signal sent to Sensor_Thread by cmd_adc()
+#define SCAN_RING 8               // Scans kept for the SCAN stream, 8 s at the default rate
+
+typedef struct {
+    uint32_t ms;                  // Kernel time
+    uint16_t adc[3];
+    uint8_t act;                  // Bit n: actuator n was on at some point since the scan before
+} ScanRecord;
+
+static volatile ScanRecord scan_ring[SCAN_RING]; // Scan n in scan_ring[n % SCAN_RING]
+volatile uint32_t scan_seq;       // Scans since boot, written after the ring entry
+volatile uint32_t actuator_ons[3]; // Times each actuator was switched on, see actuator_set()
+int replay_adc[3];                // Next replayed scan, guarded by adc_mutex
+
+// Control latency probe, for host/bench/latency_bench.c. Sensor_Thread
+// stamps the scan at which a reading crosses into an actuator's switch-on
+// range in auto mode, and the control threads take the time from there to
+// their output switching: the Monitor poll, the semaphore hop and any wait for
+// adc_mutex behind another actuator's on time. Stamps are hal_cycles(), the
+// DWT cycle counter on the board and the monotonic clock in the host build,
+// so a crossing still pending after 42 s at 100 MHz reads short. Samples go
+// out on the LAT stream from a ring, as the scans do.
+#define LAT_RING 16
+
+typedef struct {
+    uint32_t us;
+    uint8_t actuator;
+} LatRecord;
+
+static volatile LatRecord lat_ring[LAT_RING]; // Sample n in lat_ring[n % LAT_RING]
+volatile uint32_t lat_seq;        // Samples since boot, written after the ring entry
+static uint32_t cross_cycles[3];  // Scan that crossed, guarded by adc_mutex like the rest
+static int cross_pending;         // Bit n: actuator n crossed and has not switched on since
+
+// The switch-on conditions of the monitor and control threads. Caller holds
+// adc_mutex.
+static int actuator_demand(int actuator) {
+    switch (actuator) {
+        case HAL_HEATER: return temp_adc >= threadHoldtemp_adc;
+        case HAL_SPRINKLER: return moist_adc <= threadHoldmoist_adc;
+        default: return light_adc <= threadHoldlight_adc;
+    }
 }
 
-void UART0_SendString(const char *str) {
-    while (*str) {
-        while (!(LPC_UART0->LSR & (1 << 5))); // Wait for TX ready
-        LPC_UART0->THR = *str++; // Send character
+// Called by Sensor_Thread with each new scan, under adc_mutex
+static void lat_scan(void) {
+    static int demand; // Bit n: actuator n wanted on at the scan before
+    uint32_t now = hal_cycles();
+
+    for (int i = 0; i < 3; i++) {
+        int bit = 1 << i;
+        if (!auto_mode || !actuator_demand(i)) {
+            demand &= ~bit;
+            cross_pending &= ~bit; // Withdrawn before it was acted on
+        } else if (!(demand & bit)) {
+            demand |= bit;
+            cross_cycles[i] = now;
+            cross_pending |= bit;
+        }
     }
 }
 
-int Read_ADC(int channel) {
-    LPC_ADC->ADCR &= ~(0x7 << 0); // Clear channel selection
-    LPC_ADC->ADCR |= (1 << channel); // Select the specified channel
-    LPC_ADC->ADCR |= (1 << 24); // Start conversion
-    while (!(LPC_ADC->ADGDR & (1U << 31))); // Wait for conversion to complete
-    int result = (LPC_ADC->ADGDR >> 4) & 0xFFF; // Extract 12-bit ADC result
-    return result;
+// Called by the control threads once their output is on, under adc_mutex.
+// Manual switching does not end a crossing.
+static void lat_record(int actuator) {
+    volatile LatRecord *r = &lat_ring[lat_seq % LAT_RING];
+
+    if (!(cross_pending & (1 << actuator))) return;
+    cross_pending &= ~(1 << actuator);
+    r->us = (hal_cycles() - cross_cycles[actuator]) / (hal_clock_hz() / 1000000);
+    r->actuator = actuator;
+    lat_seq++;
+}
+
+// Exponential smoothing on an accumulator scaled by 2^FILTER_SHIFT
+static int filter_step(int *acc, int value, int first) {
+    if (first) *acc = value << FILTER_SHIFT;
+    else *acc += value - (*acc >> FILTER_SHIFT);
+    return *acc >> FILTER_SHIFT;
 }
 
 void Sensor_Thread(const void *arg) {
+    int acc[3];
+    int first = 1, logged;
+    MsClock clock = { 0, 0 };
+    uint32_t ons[3] = { 0, 0, 0 };
     while (1) {
+        int replay = replay_mode; // Once per scan, the mutex wait may see it change
+        thread_loops[STAT_SENSOR]++;
+        if (replay && osSignalWait(REPLAY_SCAN, sensor_period_ms).status != osEventSignal) continue;
         osMutexWait(adc_mutex, osWaitForever); // Acquire mutex for safe access
-        temp_adc = Read_ADC(0); // Read temperature sensor
-        moist_adc = Read_ADC(1); // Read moisture sensor
-        light_adc = Read_ADC(2); // Read light sensor
+        if (replay) {
+            temp_adc = replay_adc[0];
+            moist_adc = replay_adc[1];
+            light_adc = replay_adc[2];
+        } else {
+            temp_adc = hal_adc_read(0); // Read temperature sensor
+            moist_adc = hal_adc_read(1); // Read moisture sensor
+            light_adc = hal_adc_read(2); // Read light sensor
+        }
+        lat_scan();
+        {
+            volatile ScanRecord *s = &scan_ring[scan_seq % SCAN_RING];
+            int act = 0;
+            for (int i = 0; i < 3; i++) {
+                if (actuator_ons[i] != ons[i] || actuator_is_on(i)) act |= 1 << i;
+                ons[i] = actuator_ons[i];
+            }
+            s->ms = ms_clock(&clock);
+            s->adc[0] = temp_adc;
+            s->adc[1] = moist_adc;
+            s->adc[2] = light_adc;
+            s->act = act;
+            scan_seq++;
+        }
+        temp_filt = filter_step(&acc[0], temp_adc, first);
+        moist_filt = filter_step(&acc[1], moist_adc, first);
+        light_filt = filter_step(&acc[2], light_adc, first);
+        first = 0;
+        boot_mark(BOOT_SAMPLE);
+        fault_flags = (fault_flags & ~(FAULT_TEMP_SENSOR | FAULT_MOIST_SENSOR | FAULT_LIGHT_SENSOR)) |
+                      (sensor_fault(temp_adc) ? FAULT_TEMP_SENSOR : 0) |
+                      (sensor_fault(moist_adc) ? FAULT_MOIST_SENSOR : 0) |
+                      (sensor_fault(light_adc) ? FAULT_LIGHT_SENSOR : 0);
+        logged = !replay && // Replayed scans stay out of the history and the flash log
+                 (history_seq == 0 || uptime_s - history[(history_seq - 1) % HISTORY_LEN].time_s >= history_period_s);
+        if (logged) History_Append(); // Keep one sample per history period
         osMutexRelease(adc_mutex); // Release mutex
-        osDelay(1000); // Delay for 1 second
+        if (logged) Log_Append(); // May write flash, so outside adc_mutex
+        if (!replay) osDelay(sensor_period_ms); // Wait for next sample
     }
 }
 
+// Caller holds adc_mutex
+void History_Append(void) {
+    HistorySample *h = &history[history_seq % HISTORY_LEN];
+    h->time_s = uptime_s;
+    h->temp = temp_adc;
+    h->moist = moist_adc;
+    h->light = light_adc;
+    history_seq++;
+}
+
+static int log_erase(int sector) {
+    return flash_erase(LOG_SECTOR + sector);
+}
+
+static int log_program(int page, const void *data) {
+    return flash_program(LOG_BASE + page * SLOG_PAGE, data, SLOG_PAGE);
+}
+
+static const SlogFlash log_flash = {
+    (const uint8_t *)LOG_BASE, LOG_SECTORS, 0x8000, log_erase, log_program
+};
+
+// Called from main() before the kernel starts
+static void log_restore(void) {
+    SlogCursor c;
+    slog_init(&log_flash);
+    slog_seek(&c, 0xFFFFFFFF);
+    log_time_s = c.prev.time_s + 1;
+}
+
+// Called by Sensor_Thread after History_Append(), the readings are its own
+void Log_Append(void) {
+    SlogSample s = { log_time_s, { temp_adc, moist_adc, light_adc } };
+    osMutexWait(log_mutex, osWaitForever);
+    if ((log_time_s > LOG_FLUSH_S && slog_flush_before(log_time_s - LOG_FLUSH_S) != 0) || slog_append(&s) != 0)
+        fault_flags |= FAULT_LOG;
+    osMutexRelease(log_mutex);
+}
+
+void Uptime_Timer(const void *arg) {
+    static uint32_t last_idle, last_bytes;
+    uint32_t idle = os_idle_cycles - last_idle;
+    int load = 100 - (int)((uint64_t)idle * 100 / hal_clock_hz());
+
+    cpu_load_pct = load < 0 ? 0 : load;
+    glcd_bps = glcd_bytes - last_bytes;
+    last_idle += idle;
+    last_bytes += glcd_bps;
+    uptime_s++;
+    log_time_s++;
+}
+
+// Telemetry streams. The host picks which streams it wants with SUB/UNSUB,
+// each with its own period or on-change delivery, and UART_Thread merges all
+// due streams into the single UART0 output. RAW keeps the original
+// TEMP/MOIST/LIGHT line and is the only stream enabled at boot.
+#define STREAM_POLL_MS 50     // Check interval while any on-change stream is active
+#define STREAM_IDLE_MS 1000   // Longest sleep when nothing is due
+#define STREAM_WAKE 0x01      // Signal sent to UART_Thread when subscriptions change
+
+typedef struct {
+    const char *name;               // Stream name, table must stay sorted by name
+    volatile int *period_ms;        // Report period, 0 when off
+    void (*format)(FmtBuf *out);    // Appends one output line
+    const char *setting;            // Param that keeps period_ms in flash, NULL for none
+} Stream;
+
+static const char *const stat_names[STAT_COUNT] = {
+    "SENS", "UART", "HMON", "HCTL", "SMON", "SCTL", "LMON", "LCTL", "RX", "MENU", "485", "REND"
+};
+
+// Appends "<prefix>TEMP:<t>|MOIST:<m>|LIGHT:<l>\n"
+static void format_readings(FmtBuf *out, const char *prefix, int temp, int moist, int light) {
+    fmt_str(out, prefix);
+    fmt_str(out, "TEMP:");
+    fmt_int(out, temp);
+    fmt_str(out, "|MOIST:");
+    fmt_int(out, moist);
+    fmt_str(out, "|LIGHT:");
+    fmt_int(out, light);
+    fmt_char(out, '\n');
+}
+
+static void stream_act(FmtBuf *out) {
+    fmt_str(out, "ACT:HEATER:");
+    fmt_int(out, actuator_is_on(0));
+    fmt_str(out, "|SPRINKLER:");
+    fmt_int(out, actuator_is_on(1));
+    fmt_str(out, "|LIGHT:");
+    fmt_int(out, actuator_is_on(2));
+    fmt_str(out, "|AUTO:");
+    fmt_int(out, auto_mode);
+    fmt_char(out, '\n');
+}
+
+static void stream_fault(FmtBuf *out) {
+    fmt_str(out, "FAULT:");
+    fmt_hex(out, fault_flags, 2);
+    fmt_char(out, '\n');
+}
+
+static void stream_filt(FmtBuf *out) {
+    osMutexWait(adc_mutex, osWaitForever);
+    format_readings(out, "FILT:", temp_filt, moist_filt, light_filt);
+    osMutexRelease(adc_mutex);
+}
+
+static void stream_raw(FmtBuf *out) {
+    osMutexWait(adc_mutex, osWaitForever);
+    format_readings(out, "", temp_adc, moist_adc, light_adc);
+    osMutexRelease(adc_mutex);
+}
+
+// SCAN:<seq>:<ms>:<temp>:<moist>:<light>:<actuator bits> for every scan not
+// sent yet, as many as fit. Scans that left the ring unsent show as a gap
+// in the numbers.
+#define SCAN_LINE_MAX 46
+static void stream_scan(FmtBuf *out) {
+    static uint32_t sent; // First scan not sent
+    uint32_t end = scan_seq;
+
+    if (end - sent > SCAN_RING) sent = end - SCAN_RING;
+    while (sent != end && out->cap - out->len > SCAN_LINE_MAX) {
+        volatile ScanRecord *s = &scan_ring[sent % SCAN_RING];
+        fmt_str(out, "SCAN:");
+        fmt_uint(out, sent + 1); // Numbered from 1, RX lines after scan n carry n
+        fmt_char(out, ':');
+        fmt_uint(out, s->ms);
+        for (int i = 0; i < 3; i++) {
+            fmt_char(out, ':');
+            fmt_uint(out, s->adc[i]);
+        }
+        fmt_char(out, ':');
+        fmt_uint(out, s->act);
+        fmt_char(out, '\n');
+        sent++;
+    }
+}
+
+// LAT:<n>:<actuator>:<us> for every latency sample not sent yet, as for SCAN
+#define LAT_LINE_MAX 28
+static void stream_lat(FmtBuf *out) {
+    static uint32_t sent; // First sample not sent
+    uint32_t end = lat_seq;
+
+    if (end - sent > LAT_RING) sent = end - LAT_RING;
+    while (sent != end && out->cap - out->len > LAT_LINE_MAX) {
+        volatile LatRecord *r = &lat_ring[sent % LAT_RING];
+        fmt_str(out, "LAT:");
+        fmt_uint(out, sent + 1);
+        fmt_char(out, ':');
+        fmt_uint(out, r->actuator);
+        fmt_char(out, ':');
+        fmt_uint(out, r->us);
+        fmt_char(out, '\n');
+        sent++;
+    }
+}
+
+static void stream_stats(FmtBuf *out) {
+    fmt_str(out, "STATS");
+    for (int i = 0; i < STAT_COUNT; i++) {
+        fmt_char(out, i ? '|' : ':');
+        fmt_str(out, stat_names[i]);
+        fmt_char(out, ':');
+        fmt_uint(out, thread_loops[i]);
+    }
+    fmt_str(out, "|CPU:");
+    fmt_int(out, cpu_load_pct);
+    fmt_str(out, "|GLCD:");
+    fmt_int(out, glcd_bps);
+    fmt_str(out, "|FRAME:");
+    fmt_int(out, frame_us);
+    fmt_str(out, "|OVR:");
+    fmt_int(out, frame_overruns);
+    fmt_str(out, "|GLYPH:");
+    fmt_uint(out, hal_display_cache_pct());
+    fmt_char(out, '\n');
+}
+
+volatile int act_period_ms, fault_period_ms, filt_period_ms, lat_period_ms, scan_period_ms, stats_period_ms;
+
+static const Stream stream_table[] = {
+    { "ACT",   &act_period_ms,       stream_act   },
+    { "FAULT", &fault_period_ms,     stream_fault },
+    { "FILT",  &filt_period_ms,      stream_filt  },
+    { "LAT",   &lat_period_ms,       stream_lat   },
+    { "RAW",   &telemetry_period_ms, stream_raw,  "UART_RATE" },
+    { "SCAN",  &scan_period_ms,      stream_scan  },
+    { "STATS", &stats_period_ms,     stream_stats },
+};
+#define STREAM_COUNT (sizeof(stream_table) / sizeof(stream_table[0]))
+
+volatile int stream_on_change[STREAM_COUNT];  // 1: send whenever the line changes
+
+void Stream_Wake(void) {
+    osSignalSet(uart_thread_id, STREAM_WAKE);
+}
+
+static uint32_t line_hash(const char *str) {
+    uint32_t h = 2166136261u; // FNV-1a
+    while (*str) h = (h ^ (uint8_t)*str++) * 16777619u;
+    return h;
+}
+
 void UART_Thread(const void *arg) {
-    char buffer[64]; // Buffer to hold the formatted string
+    char buffer[256]; // Holds the longest line, STATS with every counter at 10 digits
+    FmtBuf out;
+    uint32_t due[STREAM_COUNT] = { 0 };
+    uint32_t last_hash[STREAM_COUNT] = { 0 };
+    MsClock clock = { osKernelSysTick(), 0 };
+    uint32_t boot_sent = 0; // Boot stages already reported
+
     while (1) {
-        osMutexWait(adc_mutex, osWaitForever); // Acquire mutex
-        sprintf(buffer, "TEMP:%d|MOIST:%d|LIGHT:%d\n", temp_adc, moist_adc, light_adc); // Format data
-        osMutexRelease(adc_mutex); // Release mutex
-        UART0_SendString(buffer); // Send string over UART
-        osDelay(3000); // Delay for 3 seconds
+        uint32_t sleep = STREAM_IDLE_MS;
+        thread_loops[STAT_UART]++;
+
+        for (int i = 0; i < BOOT_STAGES; i++) {
+            if (boot_us[i] && !(boot_sent & (1 << i))) {
+                fmt_init(&out, buffer, sizeof(buffer));
+                fmt_str(&out, "BOOT:");
+                fmt_str(&out, boot_names[i]);
+                fmt_char(&out, ':');
+                fmt_int(&out, boot_us[i]);
+                fmt_char(&out, '\n');
+                osMutexWait(uart_mutex, osWaitForever);
+                UART0_SendString(buffer);
+                osMutexRelease(uart_mutex);
+                boot_sent |= 1 << i;
+            }
+        }
+
+        uint32_t now = ms_clock(&clock);
+
+        for (unsigned i = 0; i < STREAM_COUNT; i++) {
+            int period = *stream_table[i].period_ms;
+            int send = 0;
+
+            if (stream_on_change[i]) {
+                fmt_init(&out, buffer, sizeof(buffer));
+                stream_table[i].format(&out);
+                send = line_hash(buffer) != last_hash[i];
+                if (sleep > STREAM_POLL_MS) sleep = STREAM_POLL_MS;
+            } else if (period > 0) {
+                if ((int32_t)(now - due[i]) >= 0) {
+                    fmt_init(&out, buffer, sizeof(buffer));
+                    stream_table[i].format(&out);
+                    send = 1;
+                    due[i] = (int32_t)(now - due[i]) >= period ? now + period : due[i] + period;
+                }
+                if ((int32_t)(due[i] - now) < (int32_t)sleep) sleep = due[i] - now;
+            }
+
+            if (send) {
+                last_hash[i] = line_hash(buffer);
+                osMutexWait(uart_mutex, osWaitForever);
+                UART0_SendString(buffer); // Send string over UART
+                osMutexRelease(uart_mutex);
+            }
+        }
+        osSignalWait(STREAM_WAKE, sleep); // Sleep until the next deadline or a SUB change
     }
 }
 
 void HeaterMonitor_Thread(const void *arg) {
+    wait_first_sample();
     while (1) {
+        thread_loops[STAT_HEATER_MON]++;
         osMutexWait(adc_mutex, osWaitForever); // Acquire mutex
-        if (temp_adc >= threadHoldtemp_adc) {
+        if (auto_mode && temp_adc >= threadHoldtemp_adc) {
             osSemaphoreRelease(heater_sem); // Signal to activate heater
         }
         osMutexRelease(adc_mutex); // Release mutex
+        boot_mark(BOOT_DECIDE);
         osDelay(1000); // Check every 1 second
     }
 }
 
 void HeaterControl_Thread(const void *arg) {
     while (1) {
+        thread_loops[STAT_HEATER_CTL]++;
         osSemaphoreWait(heater_sem, osWaitForever); // Wait for semaphore
         osMutexWait(adc_mutex, osWaitForever); // Acquire mutex
         if (temp_adc >= threadHoldtemp_adc) {
-            LPC_GPIO1->FIOSET = (1 << 29); // Turn on heater (P1.29)
+            actuator_set(HAL_HEATER, 1); // Turn on heater
+            lat_record(HAL_HEATER);
             osDelay(Heater_ON_Duration); // Keep on for 5 seconds
-            LPC_GPIO1->FIOCLR = (1 << 29); // Turn off heater
+            actuator_set(HAL_HEATER, 0); // Turn off heater
         }
         osMutexRelease(adc_mutex); // Release mutex
     }
@@ -164,69 +628,647 @@ void HeaterControl_Thread(const void *arg) {
 
 
 void SprinklerMonitor_Thread(const void *arg) {
+    wait_first_sample();
     while (1) {
+        thread_loops[STAT_SPRINKLER_MON]++;
         osMutexWait(adc_mutex, osWaitForever); // Acquire mutex
-        if (moist_adc <= threadHoldmoist_adc) { // Lower moisture means drier
+        if (auto_mode && moist_adc <= threadHoldmoist_adc) { // Lower moisture means drier
             osSemaphoreRelease(sprinkler_sem); // Signal to activate sprinkler
         }
         osMutexRelease(adc_mutex); // Release mutex
+        boot_mark(BOOT_DECIDE);
         osDelay(1000); // Check every 1 second
     }
 }
 
 void SprinklerControl_Thread(const void *arg) {
     while (1) {
+        thread_loops[STAT_SPRINKLER_CTL]++;
         osSemaphoreWait(sprinkler_sem, osWaitForever); // Wait for semaphore
         osMutexWait(adc_mutex, osWaitForever); // Acquire mutex
         if (moist_adc <= threadHoldmoist_adc) {
-            LPC_GPIO1->FIOSET = (1 << 31); // Turn on sprinkler (P1.31)
+            actuator_set(HAL_SPRINKLER, 1); // Turn on sprinkler
+            lat_record(HAL_SPRINKLER);
             osDelay(sprinkler_ON_Duration); // Keep on for 5 seconds
-            LPC_GPIO1->FIOCLR = (1 << 31); // Turn off sprinkler
+            actuator_set(HAL_SPRINKLER, 0); // Turn off sprinkler
         }
         osMutexRelease(adc_mutex); // Release mutex
     }
 }
 
 void LightMonitor_Thread(const void *arg) {
+    wait_first_sample();
     while (1) {
+        thread_loops[STAT_LIGHT_MON]++;
         osMutexWait(adc_mutex, osWaitForever); // Acquire mutex
-        if (light_adc <= threadHoldlight_adc) { // Lower light means darker
+        if (auto_mode && light_adc <= threadHoldlight_adc) { // Lower light means darker
             osSemaphoreRelease(light_sem); // Signal to activate light
         }
         osMutexRelease(adc_mutex); // Release mutex
+        boot_mark(BOOT_DECIDE);
         osDelay(1000); // Check every 1 second
     }
 }
 
 void LightControl_Thread(const void *arg) {
     while (1) {
+        thread_loops[STAT_LIGHT_CTL]++;
         osSemaphoreWait(light_sem, osWaitForever); // Wait for semaphore
         osMutexWait(adc_mutex, osWaitForever); // Acquire mutex
         if (light_adc <= threadHoldlight_adc) {
-            LPC_GPIO2->FIOSET = (1 << 2); // Turn on light (P2.2)
+            actuator_set(HAL_LIGHT, 1); // Turn on light
+            lat_record(HAL_LIGHT);
             osDelay(light_ON_Duration); // Keep on for 5 seconds
-            LPC_GPIO2->FIOCLR = (1 << 2); // Turn off light
+            actuator_set(HAL_LIGHT, 0); // Turn off light
         }
         osMutexRelease(adc_mutex); // Release mutex
     }
 }
 
+// UART command set. Each line is split once on ':' into tokens, the verb and
+// parameter names are then looked up by binary search in the const tables
+// below, so adding entries does not add string scans per received line.
+//
+//   GET:<PARAM>          -> ACK:<PARAM>:<value>
+//   SET:<PARAM>:<value>  -> ACK:<PARAM>:<value>
+//   CMD:<ACTUATOR>:ON|OFF (legacy) -> ACK:<ACTUATOR>:<0|1>
+//   SUB:<STREAM>:<ms>|CHG -> ACK:SUB:<STREAM>, stream sent every <ms> or on change
+//   UNSUB:<STREAM>        -> ACK:UNSUB:<STREAM>
+//   POLL                  -> RAW, ACT and FAULT lines, the RS-485 poll request
+//   ADC:<temp>:<moist>:<light> -> ACK:ADC:<scan seq>, the next scan in replay mode
+//   CRASH:<n>             -> crash record n from flash, 0 the newest, see cmd_crash()
+//   DUMP:<from>:<to>[:<seq>] -> up to HISTORY_CHUNK lines of
+//                          HIST:<seq>:<time>:<temp>:<moist>:<light>, then
+//                          ACK:DUMP:<next seq> or ACK:DUMP:END
+//   LOG:<from>:<to>      -> the same from the flash log, in log time, as
+//                          LOG:<time>:<temp>:<moist>:<light> lines, then
+//                          ACK:LOG:<next from> or ACK:LOG:END
+//   errors               -> NAK:<reason>
+
+#define CMD_MAX_TOKENS 4
+
+typedef struct {
+    const char *name;       // Parameter name, table must stay sorted by name
+    volatile int *value;    // Backing variable, NULL for actuator entries
+    int actuator;           // Actuator index for GPIO-backed entries, -1 otherwise
+    int min;                // Smallest value accepted by SET
+    int max;                // Largest value accepted by SET, below min for read-only entries
+} Param;
+
+static const Param param_table[] = {
+    { "ADDR",          &node_address,          -1, 0,   RS485_MAX_ADDR },
+    { "AUTO",          &auto_mode,             -1, 0,   1     },
+    { "CFG_SAVES",     &cfg_saves,             -1, 1,   0     },
+    { "CPU_LOAD",      &cpu_load_pct,          -1, 1,   0     },
+    { "CRASHES",       &crash_records,         -1, 1,   0     },
+    { "FAULTS",        &fault_flags,           -1, 1,   0     },
+    { "FRAME_OVR",     &frame_overruns,        -1, 1,   0     },
+    { "FRAME_US",      &frame_us,              -1, 1,   0     },
+    { "GLCD_BPS",      &glcd_bps,              -1, 1,   0     },
+    { "HEATER",        NULL,                    0, 0,   1     },
+    { "HEATER_DUR",    &Heater_ON_Duration,    -1, 0,   60000 },
+    { "HEATER_TH",     &threadHoldtemp_adc,    -1, 0,   4095  },
+    { "HIST_RATE",     &history_period_s,      -1, 1,   3600  },
+    { "IDLE_DIM",      &idle_dim_s,            -1, 0,   86400 },
+    { "IDLE_OFF",      &idle_off_s,            -1, 0,   86400 },
+    { "KEY_TEST",      &joy_test_hz,           -1, 0,   JOY_TEST_MAX_HZ },
+    { "LIGHT",         NULL,                    2, 0,   1     },
+    { "LIGHT_DUR",     &light_ON_Duration,     -1, 0,   60000 },
+    { "LIGHT_TH",      &threadHoldlight_adc,   -1, 0,   4095  },
+    { "LOG_TIME",      &log_time_s,            -1, 1,   0     },
+    { "REPLAY",        &replay_mode,           -1, 0,   1     },
+    { "SENSOR_RATE",   &sensor_period_ms,      -1, 100, 60000 },
+    { "SPRINKLER",     NULL,                    1, 0,   1     },
+    { "SPRINKLER_DUR", &sprinkler_ON_Duration, -1, 0,   60000 },
+    { "SPRINKLER_TH",  &threadHoldmoist_adc,   -1, 0,   4095  },
+    { "UART_RATE",     &telemetry_period_ms,   -1, STREAM_POLL_MS, 60000 }, // Or 0, see param_in_range()
+    { "UPTIME",        &uptime_s,              -1, 1,   0     },
+};
+
+// UART_RATE also takes 0 to turn RAW off. Anything between would have
+// UART_Thread spinning on a full 9600 baud line.
+static int param_in_range(const Param *p, int value) {
+    if (p->value == &telemetry_period_ms && value == 0) return 1;
+    return value >= p->min && value <= p->max;
+}
+
+typedef struct {
+    const char *name;       // Verb, table must stay sorted by name
+    int min_tokens;         // Tokens required including the verb
+    void (*handler)(char **tok, int ntok, void (*reply)(const char *));
+} Command;
+
+static int find_entry(const void *table, int count, int stride, const char *name) {
+    int lo = 0, hi = count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const char *entry = *(const char * const *)((const char *)table + mid * stride);
+        int cmp = strcmp(name, entry);
+        if (cmp == 0) return mid;
+        if (cmp < 0) hi = mid - 1; else lo = mid + 1;
+    }
+    return -1;
+}
+
+static int parse_int(const char *str, int *out) {
+    int sign = 1, value = 0;
+    if (*str == '-') { sign = -1; str++; }
+    if (*str == '\0') return 0;
+    while (*str) {
+        if (*str < '0' || *str > '9' || value > 99999999) return 0;
+        value = value * 10 + (*str++ - '0');
+    }
+    *out = sign * value;
+    return 1;
+}
+
+static int param_get(const Param *p) {
+    return p->value ? *p->value : actuator_is_on(p->actuator);
+}
+
+static void param_reply(const Param *p, void (*reply)(const char *)) {
+    char out[48];
+    FmtBuf f;
+    fmt_init(&f, out, sizeof(out));
+    fmt_str(&f, "ACK:");
+    fmt_str(&f, p->name);
+    fmt_char(&f, ':');
+    fmt_int(&f, param_get(p));
+    fmt_char(&f, '\n');
+    reply(out);
+}
+
+static const Param *param_lookup(const char *name, void (*reply)(const char *)) {
+    int i = find_entry(param_table, sizeof(param_table) / sizeof(param_table[0]), sizeof(Param), name);
+    if (i < 0) {
+        reply("NAK:UNKNOWN_PARAM\n");
+        return NULL;
+    }
+    return &param_table[i];
+}
+
+// Settings kept in flash by cfg_store, saved as ints in this order. Add new
+// names at the end, older records then restore the ones they hold; bump
+// CFG_VERSION when an entry is removed or moved. Config_Thread saves once no
+// edit has come in for CFG_SAVE_DELAY_MS, so holding a joystick key or a
+// burst of SET commands costs one flash record.
+#define CFG_VERSION 1
+#define CFG_SAVE_DELAY_MS 5000
+#define CFG_SAVE_MAX_S 60         // Save anyway when edits keep coming this long
+#define CFG_DIRTY 0x01            // Signal sent to Config_Thread by param_store()
+
+static const char *const cfg_names[] = {
+    "HEATER_TH", "SPRINKLER_TH", "LIGHT_TH", "HEATER_DUR", "SPRINKLER_DUR", "LIGHT_DUR",
+    "AUTO", "ADDR", "SENSOR_RATE", "UART_RATE", "HIST_RATE", "IDLE_DIM", "IDLE_OFF"
+};
+
+#define CFG_COUNT ((int)(sizeof(cfg_names) / sizeof(cfg_names[0])))
+
+static const Param *cfg_params[CFG_COUNT];
+
+// Called from main() before the kernel starts
+static void config_restore(void) {
+    int32_t values[CFG_COUNT];
+    int n;
+
+    for (int i = 0; i < CFG_COUNT; i++) {
+        cfg_params[i] = &param_table[find_entry(param_table, sizeof(param_table) / sizeof(param_table[0]),
+                                                sizeof(Param), cfg_names[i])];
+    }
+    if (cfg_store_init() != 0) return; // Nothing saved yet, keep the defaults
+    n = cfg_store_load(values, sizeof(values), CFG_VERSION) / sizeof(values[0]);
+    for (int i = 0; i < n; i++) {
+        const Param *p = cfg_params[i];
+        if (param_in_range(p, values[i])) *p->value = values[i];
+    }
+}
+
+void Config_Thread(const void *arg) {
+    int32_t values[CFG_COUNT];
+    while (1) {
+        int start, result;
+        osSignalWait(CFG_DIRTY, osWaitForever);
+        start = uptime_s;
+        while (uptime_s - start < CFG_SAVE_MAX_S &&
+               osSignalWait(CFG_DIRTY, CFG_SAVE_DELAY_MS).status == osEventSignal); // Batch edits
+        for (int i = 0; i < CFG_COUNT; i++) values[i] = *cfg_params[i]->value;
+        result = cfg_store_save(values, sizeof(values), CFG_VERSION);
+        if (result >= 0) {
+            if (result == 0) cfg_saves++; // Not when only unsaved parameters changed
+            fault_flags &= ~FAULT_CONFIG;
+        } else {
+            fault_flags |= FAULT_CONFIG;
+        }
+    }
+}
+
+// Checks and applies a new value. Returns the NAK to send, NULL once done.
+static const char *param_write(const Param *p, int value) {
+    if (p->min > p->max) return "NAK:READ_ONLY\n";
+    if (!param_in_range(p, value)) return "NAK:RANGE\n";
+    crash_trace(TRACE_PARAM, p - param_table);
+    if (p->value) {
+        *p->value = value;
+        osSignalSet(config_thread_id, CFG_DIRTY); // Saved later if it is a setting
+    } else {
+        actuator_set(p->actuator, value);
+    }
+    Stream_Wake(); // Rates may have changed
+    return NULL;
+}
+
+static void param_store(const Param *p, int value, void (*reply)(const char *)) {
+    const char *nak = param_write(p, value);
+    if (nak) reply(nak); else param_reply(p, reply);
+}
+
+static void cmd_get(char **tok, int ntok, void (*reply)(const char *)) {
+    const Param *p = param_lookup(tok[1], reply);
+    if (p) param_reply(p, reply);
+}
+
+static void cmd_set(char **tok, int ntok, void (*reply)(const char *)) {
+    int value;
+    const Param *p = param_lookup(tok[1], reply);
+    if (!p) return;
+    if (!parse_int(tok[2], &value)) {
+        reply("NAK:SYNTAX\n");
+        return;
+    }
+    param_store(p, value, reply);
+}
+
+static void cmd_legacy(char **tok, int ntok, void (*reply)(const char *)) {
+    const Param *p = param_lookup(tok[1], reply);
+    if (!p) return;
+    if (p->actuator < 0) {
+        reply("NAK:UNKNOWN_PARAM\n");
+    } else if (strcmp(tok[2], "ON") == 0) {
+        param_store(p, 1, reply);
+    } else if (strcmp(tok[2], "OFF") == 0) {
+        param_store(p, 0, reply);
+    } else {
+        reply("NAK:SYNTAX\n");
+    }
+}
+
+// Streams one chunk of history between two uptimes. The host resumes with the
+// returned sequence number, so a dump can be paced and restarted at will and
+// the UART is only held for one line at a time.
+static void cmd_dump(char **tok, int ntok, void (*reply)(const char *)) {
+    HistorySample chunk[HISTORY_CHUNK];
+    char out[64];
+    FmtBuf f;
+    int from, to, start = 0;
+    uint32_t seq, first, end;
+    int n = 0;
+
+    if (!parse_int(tok[1], &from) || !parse_int(tok[2], &to) ||
+        (ntok > 3 && !parse_int(tok[3], &start))) {
+        reply("NAK:SYNTAX\n");
+        return;
+    }
+
+    osMutexWait(adc_mutex, osWaitForever);
+    end = history_seq;
+    first = end > HISTORY_LEN ? end - HISTORY_LEN : 0;
+    if ((uint32_t)start > first) first = start;
+    // Binary search for the first retained sample at or after 'from'
+    while (first < end) {
+        uint32_t mid = first + (end - first) / 2;
+        if (history[mid % HISTORY_LEN].time_s < (uint32_t)from) first = mid + 1;
+        else end = mid;
+    }
+    end = history_seq;
+    for (seq = first; seq < end && n < HISTORY_CHUNK; seq++) {
+        if (history[seq % HISTORY_LEN].time_s > (uint32_t)to) break;
+        chunk[n++] = history[seq % HISTORY_LEN];
+    }
+    osMutexRelease(adc_mutex);
+
+    for (int i = 0; i < n; i++) {
+        fmt_init(&f, out, sizeof(out));
+        fmt_str(&f, "HIST:");
+        fmt_uint(&f, first + i);
+        fmt_char(&f, ':');
+        fmt_uint(&f, chunk[i].time_s);
+        fmt_char(&f, ':');
+        fmt_uint(&f, chunk[i].temp);
+        fmt_char(&f, ':');
+        fmt_uint(&f, chunk[i].moist);
+        fmt_char(&f, ':');
+        fmt_uint(&f, chunk[i].light);
+        fmt_char(&f, '\n');
+        reply(out);
+    }
+    if (n == HISTORY_CHUNK && seq < end && history[seq % HISTORY_LEN].time_s <= (uint32_t)to) {
+        fmt_init(&f, out, sizeof(out));
+        fmt_str(&f, "ACK:DUMP:");
+        fmt_uint(&f, seq);
+        fmt_char(&f, '\n');
+        reply(out);
+    } else {
+        reply("ACK:DUMP:END\n");
+    }
+}
+
+// Same paging as cmd_dump() over the flash log. Log times are unique, so the
+// host resumes at the returned time.
+static void cmd_log(char **tok, int ntok, void (*reply)(const char *)) {
+    SlogSample chunk[HISTORY_CHUNK + 1];
+    SlogCursor c;
+    char out[64];
+    FmtBuf f;
+    int from, to, n;
+
+    if (!parse_int(tok[1], &from) || !parse_int(tok[2], &to)) {
+        reply("NAK:SYNTAX\n");
+        return;
+    }
+
+    osMutexWait(log_mutex, osWaitForever);
+    slog_seek(&c, from);
+    n = slog_read(&c, chunk, HISTORY_CHUNK + 1); // One more tells whether to go on
+    osMutexRelease(log_mutex);
+    while (n > 0 && chunk[n - 1].time_s > (uint32_t)to) n--;
+
+    for (int i = 0; i < n && i < HISTORY_CHUNK; i++) {
+        fmt_init(&f, out, sizeof(out));
+        fmt_str(&f, "LOG:");
+        fmt_uint(&f, chunk[i].time_s);
+        for (int ch = 0; ch < SLOG_CHANNELS; ch++) {
+            fmt_char(&f, ':');
+            fmt_uint(&f, chunk[i].value[ch]);
+        }
+        fmt_char(&f, '\n');
+        reply(out);
+    }
+    if (n > HISTORY_CHUNK) {
+        fmt_init(&f, out, sizeof(out));
+        fmt_str(&f, "ACK:LOG:");
+        fmt_uint(&f, chunk[HISTORY_CHUNK].time_s);
+        fmt_char(&f, '\n');
+        reply(out);
+    } else {
+        reply("ACK:LOG:END\n");
+    }
+}
+
+// Sends crash record <n>, 0 being the newest, as
+//   CRASH:<n>:<seq>:<reason>:<task id>:<thread>
+//   REGS:<r0>:<r1>:<r2>:<r3>:<r12>:<lr>:<pc>:<xpsr>
+//   FSR:<cfsr>:<hfsr>:<mmfar>:<bfar>:<exc_return>:<msp>:<psp>
+//   STACK:<8 words>, CRASH_STACK_WORDS / 8 lines
+//   TRACE:<us>:<event>:<arg>, oldest first
+// all numbers but n in hex, then ACK:CRASH:<records in flash>.
+static void hex_words(FmtBuf *f, const uint32_t *words, int count) {
+    for (int i = 0; i < count; i++) {
+        fmt_char(f, ':');
+        fmt_hex(f, words[i], 8);
+    }
+}
+
+static void cmd_crash(char **tok, int ntok, void (*reply)(const char *)) {
+    const CrashRecord *r;
+    char out[96];
+    FmtBuf f;
+    int n;
+    uint32_t first;
+
+    if (!parse_int(tok[1], &n)) {
+        reply("NAK:SYNTAX\n");
+        return;
+    }
+    r = crash_get(n);
+    if (!r) {
+        reply("NAK:NO_CRASH\n");
+        return;
+    }
+
+    fmt_init(&f, out, sizeof(out));
+    fmt_str(&f, "CRASH:");
+    fmt_int(&f, n);
+    hex_words(&f, &r->seq, 2);
+    fmt_char(&f, ':');
+    fmt_hex(&f, r->task_id, 2);
+    hex_words(&f, &r->thread, 1);
+    fmt_char(&f, '\n');
+    reply(out);
+    fmt_init(&f, out, sizeof(out));
+    fmt_str(&f, "REGS");
+    hex_words(&f, r->frame, 8);
+    fmt_char(&f, '\n');
+    reply(out);
+    fmt_init(&f, out, sizeof(out));
+    fmt_str(&f, "FSR");
+    hex_words(&f, &r->cfsr, 4);
+    hex_words(&f, &r->exc_return, 3);
+    fmt_char(&f, '\n');
+    reply(out);
+    for (int i = 0; i < CRASH_STACK_WORDS; i += 8) {
+        fmt_init(&f, out, sizeof(out));
+        fmt_str(&f, "STACK");
+        hex_words(&f, &r->stack[i], 8);
+        fmt_char(&f, '\n');
+        reply(out);
+    }
+    first = r->trace_count > TRACE_LEN ? r->trace_count - TRACE_LEN : 0;
+    for (uint32_t i = first; i < r->trace_count; i++) {
+        const TraceEntry *e = &r->trace[i % TRACE_LEN];
+        fmt_init(&f, out, sizeof(out));
+        fmt_str(&f, "TRACE:");
+        fmt_hex(&f, e->time_us, 8);
+        fmt_char(&f, ':');
+        fmt_hex(&f, e->event, 2);
+        fmt_char(&f, ':');
+        fmt_hex(&f, e->arg, 4);
+        fmt_char(&f, '\n');
+        reply(out);
+    }
+    fmt_init(&f, out, sizeof(out));
+    fmt_str(&f, "ACK:CRASH:");
+    fmt_int(&f, crash_count());
+    fmt_char(&f, '\n');
+    reply(out);
+}
+
+static void reply_ack(const char *verb, const char *name, void (*reply)(const char *)) {
+    char out[32];
+    FmtBuf f;
+    fmt_init(&f, out, sizeof(out));
+    fmt_str(&f, "ACK:");
+    fmt_str(&f, verb);
+    fmt_char(&f, ':');
+    fmt_str(&f, name);
+    fmt_char(&f, '\n');
+    reply(out);
+}
+
+static int stream_lookup(const char *name, void (*reply)(const char *)) {
+    int i = find_entry(stream_table, STREAM_COUNT, sizeof(Stream), name);
+    if (i < 0) reply("NAK:UNKNOWN_STREAM\n");
+    return i;
+}
+
+// A period kept as a setting changes as SET would change it: within the
+// setting's range, and saved to flash
+static const char *stream_period(int i, int period) {
+    if (stream_table[i].setting) {
+        int k = find_entry(param_table, sizeof(param_table) / sizeof(param_table[0]), sizeof(Param),
+                           stream_table[i].setting);
+        return param_write(&param_table[k], period);
+    }
+    if (period != 0 && (period < STREAM_POLL_MS || period > 3600000)) return "NAK:RANGE\n";
+    *stream_table[i].period_ms = period;
+    return NULL;
+}
+
+static void cmd_sub(char **tok, int ntok, void (*reply)(const char *)) {
+    int period;
+    int i = stream_lookup(tok[1], reply);
+    if (i < 0) return;
+    if (strcmp(tok[2], "CHG") == 0) {
+        stream_on_change[i] = 1;
+    } else {
+        const char *nak = "NAK:RANGE\n";
+        if (parse_int(tok[2], &period) && period != 0) nak = stream_period(i, period);
+        if (nak) {
+            reply(nak);
+            return;
+        }
+        stream_on_change[i] = 0;
+    }
+    Stream_Wake();
+    reply_ack("SUB", stream_table[i].name, reply);
+}
+
+static void cmd_unsub(char **tok, int ntok, void (*reply)(const char *)) {
+    int i = stream_lookup(tok[1], reply);
+    if (i < 0) return;
+    stream_on_change[i] = 0;
+    stream_period(i, 0);
+    Stream_Wake();
+    reply_ack("UNSUB", stream_table[i].name, reply);
+}
+
+// Hands one scan to Sensor_Thread in replay mode. The reply carries the
+// number of the scan before it, the replayed one being the next.
+static void cmd_adc(char **tok, int ntok, void (*reply)(const char *)) {
+    int value[3];
+    char out[32];
+    FmtBuf f;
+
+    for (int i = 0; i < 3; i++) {
+        if (!parse_int(tok[i + 1], &value[i]) || value[i] < 0 || value[i] > 0xFFF) {
+            reply("NAK:RANGE\n");
+            return;
+        }
+    }
+    if (!replay_mode) {
+        reply("NAK:NOT_REPLAY\n");
+        return;
+    }
+    osMutexWait(adc_mutex, osWaitForever);
+    memcpy(replay_adc, value, sizeof(replay_adc));
+    fmt_init(&f, out, sizeof(out));
+    fmt_str(&f, "ACK:ADC:");
+    fmt_uint(&f, scan_seq);
+    fmt_char(&f, '\n');
+    osMutexRelease(adc_mutex);
+    osSignalSet(sensor_thread_id, REPLAY_SCAN);
+    reply(out);
+}
+
+static void cmd_poll(char **tok, int ntok, void (*reply)(const char *)) {
+    char out[64];
+    FmtBuf f;
+    void (*const parts[])(FmtBuf *) = { stream_raw, stream_act, stream_fault };
+    for (unsigned i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        fmt_init(&f, out, sizeof(out));
+        parts[i](&f);
+        reply(out);
+    }
+}
+
+static const Command command_table[] = {
+    { "ADC", 4, cmd_adc },
+    { "CMD", 3, cmd_legacy },
+    { "CRASH", 2, cmd_crash },
+    { "DUMP", 3, cmd_dump },
+    { "GET", 2, cmd_get },
+    { "LOG", 3, cmd_log },
+    { "POLL", 1, cmd_poll },
+    { "SET", 3, cmd_set },
+    { "SUB", 3, cmd_sub },
+    { "UNSUB", 2, cmd_unsub },
+};
+
+void Command_Execute(char *line, void (*reply)(const char *)) {
+    char *tok[CMD_MAX_TOKENS];
+    int ntok = 0;
+    int i;
+
+    // Split in place on ':'
+    tok[ntok++] = line;
+    for (char *c = line; *c && ntok < CMD_MAX_TOKENS; c++) {
+        if (*c == ':') {
+            *c = '\0';
+            tok[ntok++] = c + 1;
+        }
+    }
+    if (line[0] == '\0') return; // Ignore empty lines
+
+    i = find_entry(command_table, sizeof(command_table) / sizeof(command_table[0]), sizeof(Command), tok[0]);
+    if (i < 0) {
+        reply("NAK:UNKNOWN_CMD\n");
+    } else if (ntok < command_table[i].min_tokens) {
+        reply("NAK:SYNTAX\n");
+    } else {
+        crash_trace(TRACE_COMMAND, i);
+        command_table[i].handler(tok, ntok, reply);
+    }
+}
+
+static void Discard_Reply(const char *str) {
+}
+
+static void UART0_Reply(const char *str) {
+    osMutexWait(uart_mutex, osWaitForever);
+    UART0_SendString(str);
+    osMutexRelease(uart_mutex);
+}
+
+// While the SCAN stream is on, echoes a console command as
+// RX:<scan seq>:<line>, the scan it came after, for the trace. ADC commands
+// come back as the scans themselves.
+static void trace_rx(const char *line) {
+    int i = find_entry(stream_table, STREAM_COUNT, sizeof(Stream), "SCAN");
+    char out[96];
+    FmtBuf f;
+
+    if ((!stream_on_change[i] && !scan_period_ms) || strncmp(line, "ADC:", 4) == 0) return;
+    fmt_init(&f, out, sizeof(out));
+    fmt_str(&f, "RX:");
+    fmt_uint(&f, scan_seq);
+    fmt_char(&f, ':');
+    fmt_str(&f, line);
+    fmt_char(&f, '\n');
+    UART0_Reply(out);
+}
+
 void UART_ReceiveThread(const void *arg) {
     char buffer[64];
     int idx = 0; // Index for the buffer
     while (1) {
-        if (LPC_UART0->LSR & 0x01) { // Check if data is available
-            char c = LPC_UART0->RBR; // Read received byte
+        thread_loops[STAT_UART_RX]++;
+        int c;
+        if (hal_uart_errors(HAL_UART_CONSOLE)) fault_flags |= FAULT_UART_RX;
+        while ((c = hal_uart_getc(HAL_UART_CONSOLE)) >= 0) { // Drain all received bytes
+            if (c == '\r') continue; // Accept CRLF line endings
             if (c == '\n' || idx >= 63) { // End of command or buffer full
                 buffer[idx] = '\0'; idx = 0; // Null-terminate the string and reset index
-                if (strncmp(buffer, "CMD:", 4) == 0) { // Check for command prefix
-                    if (strstr(buffer, "HEATER:ON")) LPC_GPIO1->FIOSET = (1 << 29); // Turn on heater
-                    if (strstr(buffer, "HEATER:OFF")) LPC_GPIO1->FIOCLR = (1 << 29); // Turn off heater
-                    if (strstr(buffer, "LIGHT:ON")) LPC_GPIO2->FIOSET = (1 << 2); // Turn on light
-                    if (strstr(buffer, "LIGHT:OFF")) LPC_GPIO2->FIOCLR = (1 << 2); // Turn off light
-                    if (strstr(buffer, "SPRINKLER:ON")) LPC_GPIO1->FIOSET = (1 << 31); // Turn on sprinkler
-                    if (strstr(buffer, "SPRINKLER:OFF")) LPC_GPIO1->FIOCLR = (1 << 31); // Turn off sprinkler
-                }
+                if (buffer[0] != '\0') trace_rx(buffer);
+                Command_Execute(buffer, UART0_Reply);
             } else {
                 buffer[idx++] = c; // Store received character
             }
@@ -235,510 +1277,578 @@ void UART_ReceiveThread(const void *arg) {
     }
 }
 
-void Menu_Display(int prev_selected_menu) {
-    static int first_call = 1; // Flag to check if it's the first call
-    const char *menu_items[] = {
-        "Show Sensors Data",
-        "Manual Control",
-        "Adjust Heater Thresh",
-        "Adjust Sprinkler Thresh",
-        "Adjust Light Thresh",
-        "Exit Menu"
-    };
-
-    osMutexWait(glcd_mutex, osWaitForever); // Acquire GLCD mutex
-
-    if (first_call || prev_selected_menu == -1) {
-        // Initial full display or forced redraw
-        GLCD_SetBackgroundColor(White);
-        GLCD_ClearScreen();
-        GLCD_SetForegroundColor(Blue);
-        GLCD_DrawString(0, 0, "Greenhouse Menu"); // Print title
-        for (int i = 0; i < 6; i++) {
-            char displayText[35];
-            sprintf(displayText, i == selected_menu ? "> %s" : "%s", menu_items[i]);
-            GLCD_SetBackgroundColor(i == selected_menu ? 0xC0C0C0 : White); // Gray for selected, white for others
-            GLCD_DrawString(0, (i + 2) * 24, displayText);
-        }
-        first_call = 0; // Mark as initialized
-    } else if (prev_selected_menu != selected_menu) {
-        // Update only the changed menu items
-        char displayText[35];
-        // Clear and redraw previous selected item to remove highlight
-        GLCD_SetBackgroundColor(White);
-        GLCD_SetForegroundColor(Blue);
-        GLCD_DrawString(0, (prev_selected_menu + 2) * 24, "                    "); // Clear line
-        sprintf(displayText, "%s", menu_items[prev_selected_menu]); // Remove '>'
-        GLCD_DrawString(0, (prev_selected_menu + 2) * 24, displayText);
-        // Clear and draw new selected item with highlight
-        GLCD_SetBackgroundColor(0xC0C0C0); // Gray for selected
-        GLCD_DrawString(0, (selected_menu + 2) * 24, "                    "); // Clear line
-        sprintf(displayText, "> %s", menu_items[selected_menu]); // Add '>'
-        GLCD_DrawString(0, (selected_menu + 2) * 24, displayText);
-    }
-
-    GLCD_SetBackgroundColor(White); // Reset background to white
-    osMutexRelease(glcd_mutex); // Release GLCD mutex
-}
-
-void actuator_control(void) {
-    static int first_call = 1; // Flag for initial draw
-    int selected_actuator = 0; // 0: Heater, 1: Sprinkler, 2: Light
-    int prev_selected_actuator = -1; // Track previous selection
-    uint32_t current_joystick_state = 0;
-    uint32_t prev_joystick_state = 0;
-    uint32_t last_action_time = 0;
-
-    // Initial full display
-    if (first_call) {
-        osMutexWait(glcd_mutex, osWaitForever);
-        GLCD_SetBackgroundColor(White);
-        GLCD_ClearScreen();
-        GLCD_SetForegroundColor(Blue);
-        GLCD_DrawString(0, 0 * 24, "Actuators Control");
-        // Draw all actuators initially
-        const char *actuator_names[] = {"Heater", "Sprinkler", "Light"};
-        for (int i = 0; i < 3; i++) {
-            char displayText[35];
-            GLCD_SetBackgroundColor(i == selected_actuator ? 0xC0C0C0 : White);
-            GLCD_DrawString(0, (i + 2) * 24, "                    "); // Clear line
-            sprintf(displayText, i == selected_actuator ? "> %s: %s" : "%s: %s",
-                    actuator_names[i],
-                    i == 0 ? (LPC_GPIO1->FIOPIN & (1 << 29) ? "ON" : "OFF") :
-                    i == 1 ? (LPC_GPIO1->FIOPIN & (1 << 31) ? "ON" : "OFF") :
-                             (LPC_GPIO2->FIOPIN & (1 << 2) ? "ON" : "OFF"));
-            GLCD_SetForegroundColor(Blue);
-            GLCD_DrawString(0, (i + 2) * 24, displayText);
-        }
-        GLCD_SetForegroundColor(Red);
-        GLCD_DrawString(0, 6 * 24, "Up/Dn:Select L/R:ON/OFF");
-        GLCD_DrawString(0, 7 * 24, "Center:Exit");
-        osMutexRelease(glcd_mutex);
-        first_call = 0;
+// Display calls in the current colours that also account the SPI traffic
+// they cause
+static uint32_t glcd_fg = Black; // Colours last set
+static uint32_t glcd_bg = White;
+
+static void glcd_foreground(uint32_t color) {
+    glcd_fg = color;
+}
+
+static void glcd_background(uint32_t color) {
+    glcd_bg = color;
+}
+
+static void glcd_char(uint32_t x, uint32_t y, char c) {
+    glcd_bytes += GLCD_GLYPH_BYTES;
+    hal_display_char(x, y, c, glcd_fg, glcd_bg);
+}
+
+static void glcd_string(uint32_t x, uint32_t y, const char *str) {
+    for (; *str && x < GLCD_WIDTH; str++, x += 16) glcd_char(x, y, *str);
+}
+
+static void glcd_fill(int x, int y, int w, int h) {
+    glcd_bytes += w * h * 2 + GLCD_WINDOW_BYTES;
+    hal_display_fill(x, y, w, h, glcd_bg);
+}
+
+static void glcd_clear(void) {
+    glcd_fill(0, 0, GLCD_WIDTH, GLCD_HEIGHT);
+}
+
+// Redraws a whole text row in one pass: the text, then background to the
+// right edge. Replaces blanking the row and drawing over it.
+static void glcd_line(uint32_t y, const char *text) {
+    glcd_bytes += GLCD_WIDTH * 24 * 2 + GLCD_WINDOW_BYTES;
+    hal_display_line(y, text, glcd_fg, glcd_bg);
+}
+
+// The panel shows readings and thresholds in percent of the ADC full scale
+// with one decimal, 1600 as 39.1%. The UART keeps the raw counts.
+static void format_reading(FmtBuf *f, int adc) {
+    fmt_fixed(f, (adc * 1000 + ADC_MAX / 2) / ADC_MAX, 1);
+    fmt_char(f, '%');
+}
+
+static void format_value(char *out, int size, const char *label, int value) {
+    FmtBuf f;
+    fmt_init(&f, out, size);
+    fmt_str(&f, label);
+    format_reading(&f, value);
+}
+
+static int rs485_answered; // Set once the turnaround pause for a request is done
+
+static void RS485_Reply(const char *line) {
+    char frame[RS485_MAX_FRAME];
+    if (!rs485_answered) {
+        osDelay(RS485_TURNAROUND_MS);
+        rs485_answered = 1;
     }
+    if (rs485_frame(frame, sizeof(frame), RS485_RESPONSE, node_address, line)) {
+        UART1_SendString(frame);
+    }
+}
 
+// Multi-drop node. Only frames for node_address are answered, each answer
+// ends with an END frame so the host knows the bus is free again. Broadcast
+// frames are executed silently.
+void RS485_Thread(const void *arg) {
+    char buffer[RS485_MAX_FRAME];
+    int idx = 0;
+    int addr;
+    char *payload;
     while (1) {
-        current_joystick_state = readJoystick();
-        uint32_t currentTime = osKernelSysTick();
-
-        // Only process input if debounce time has passed
-        if (currentTime - last_action_time >= DEBOUNCE_TIME) {
-            int update_display = 0;
-            int toggled = 0;
-
-            if ((current_joystick_state & 0x01) && !(prev_joystick_state & 0x01)) { // Up pressed
-                prev_selected_actuator = selected_actuator;
-                selected_actuator = (selected_actuator > 0) ? selected_actuator - 1 : 0;
-                update_display = 1;
-                last_action_time = currentTime;
-            }
-            if ((current_joystick_state & 0x02) && !(prev_joystick_state & 0x02)) { // Down pressed
-                prev_selected_actuator = selected_actuator;
-                selected_actuator = (selected_actuator < 2) ? selected_actuator + 1 : 2;
-                update_display = 1;
-                last_action_time = currentTime;
-            }
-            if ((current_joystick_state & (0x08 | 0x10)) && !(prev_joystick_state & (0x08 | 0x10))) { // Left or Right pressed
-                toggle_gpio(selected_actuator); // Toggle selected actuator
-                update_display = 1;
-                toggled = 1;
-                last_action_time = currentTime;
-            }
-            if ((current_joystick_state & 0x04) && !(prev_joystick_state & 0x04)) { // Center pressed
-                first_call = 1; // Reset for next entry
-                last_action_time = currentTime;
-                break;
-            }
-
-            // Update display only if needed
-            if (update_display) {
-                osMutexWait(glcd_mutex, osWaitForever);
-                const char *actuator_names[] = {"Heater", "Sprinkler", "Light"};
-                char displayText[35];
-
-                if (toggled) {
-                    // Update only the toggled actuator
-                    GLCD_SetBackgroundColor(0xC0C0C0); // Selected
-                    GLCD_DrawString(0, (selected_actuator + 2) * 24, "                    ");
-                    sprintf(displayText, "> %s: %s", actuator_names[selected_actuator],
-                            selected_actuator == 0 ? (LPC_GPIO1->FIOPIN & (1 << 29) ? "ON" : "OFF") :
-                            selected_actuator == 1 ? (LPC_GPIO1->FIOPIN & (1 << 31) ? "ON" : "OFF") :
-                                                     (LPC_GPIO2->FIOPIN & (1 << 2) ? "ON" : "OFF"));
-                    GLCD_SetForegroundColor(Blue);
-                    GLCD_DrawString(0, (selected_actuator + 2) * 24, displayText);
-                } else if (prev_selected_actuator != selected_actuator) {
-                    // Update previous and current actuators
-                    if (prev_selected_actuator != -1) {
-                        GLCD_SetBackgroundColor(White);
-                        GLCD_DrawString(0, (prev_selected_actuator + 2) * 24, "                    ");
-                        sprintf(displayText, "%s: %s", actuator_names[prev_selected_actuator],
-                                prev_selected_actuator == 0 ? (LPC_GPIO1->FIOPIN & (1 << 29) ? "ON" : "OFF") :
-                                prev_selected_actuator == 1 ? (LPC_GPIO1->FIOPIN & (1 << 31) ? "ON" : "OFF") :
-                                                             (LPC_GPIO2->FIOPIN & (1 << 2) ? "ON" : "OFF"));
-                        GLCD_SetForegroundColor(Blue);
-                        GLCD_DrawString(0, (prev_selected_actuator + 2) * 24, displayText);
+        thread_loops[STAT_RS485]++;
+        int c;
+        while ((c = hal_uart_getc(HAL_UART_RS485)) >= 0) {
+            if (c == '\r') continue;
+            if (c == RS485_REQUEST) idx = 0; // Resynchronise on every frame start
+            if (c == '\n' || idx >= RS485_MAX_FRAME - 1) {
+                buffer[idx] = '\0'; idx = 0;
+                if (node_address && rs485_parse(buffer, RS485_REQUEST, &addr, &payload)) {
+                    if (addr == RS485_BROADCAST) {
+                        Command_Execute(payload, Discard_Reply);
+                    } else if (addr == node_address) {
+                        rs485_answered = 0;
+                        Command_Execute(payload, RS485_Reply);
+                        RS485_Reply("END");
                     }
-                    GLCD_SetBackgroundColor(0xC0C0C0);
-                    GLCD_DrawString(0, (selected_actuator + 2) * 24, "                    ");
-                    sprintf(displayText, "> %s: %s", actuator_names[selected_actuator],
-                            selected_actuator == 0 ? (LPC_GPIO1->FIOPIN & (1 << 29) ? "ON" : "OFF") :
-                            selected_actuator == 1 ? (LPC_GPIO1->FIOPIN & (1 << 31) ? "ON" : "OFF") :
-                                                     (LPC_GPIO2->FIOPIN & (1 << 2) ? "ON" : "OFF"));
-                    GLCD_SetForegroundColor(Blue);
-                    GLCD_DrawString(0, (selected_actuator + 2) * 24, displayText);
                 }
-                osMutexRelease(glcd_mutex);
+            } else {
+                buffer[idx++] = c;
             }
         }
-        prev_joystick_state = current_joystick_state;
-        osDelay(20); // Maintain responsiveness
+        osDelay(2); // The 16 byte FIFO holds about 4 ms at 38400 baud
+    }
+}
+
+// Redraws only the cells of one text row that differ from 'shown', the copy
+// of what is on the panel. Caller holds glcd_mutex.
+static void draw_changed(int row, char *shown, const char *text) {
+    for (int col = 0; col < GLCD_COLS; col++) {
+        char c = *text ? *text++ : ' ';
+        if (shown[col] != c) {
+            glcd_char(col * 16, row * 24, c);
+            shown[col] = c;
+        }
     }
+}
+
+// Idle policy. After idle_dim_s without joystick input the backlight drops
+// to half, after idle_off_s it goes off, rendering stops and SSP1 is powered
+// down. The panel keeps its picture in GRAM, so waking only needs the
+// backlight back on; the next frame then catches up on whatever changed.
+// Power changes are made by Render_Thread under glcd_mutex, and anything
+// drawing checks ui_power under the same mutex.
+#define UI_DIRTY 0x01             // Signal to Render_Thread: the model changed
+
+enum { UI_OFF = HAL_DISPLAY_OFF, UI_DIM = HAL_DISPLAY_DIM, UI_AWAKE = HAL_DISPLAY_ON };
+static volatile int ui_power = UI_AWAKE;
+static volatile int last_input_s;       // uptime_s at the last button press
+
+// Called by Render_Thread on every wake-up
+static void ui_power_update(void) {
+    int idle = uptime_s - last_input_s;
+    int level = UI_AWAKE;
+
+    if (idle_dim_s && idle >= idle_dim_s) level = UI_DIM;
+    if (idle_off_s && idle >= idle_off_s) level = UI_OFF;
+    if (level == ui_power) return;
 
-    // Return to the menu
     osMutexWait(glcd_mutex, osWaitForever);
-    GLCD_SetBackgroundColor(White);
-    GLCD_ClearScreen();
+    hal_display_power(level); // Nothing draws while off, until the next press
+    ui_power = level;
     osMutexRelease(glcd_mutex);
-    Menu_Display(-1); // Force full redraw on return
 }
 
-void show_sensors_on_glcd(void) {
-    char line1[32];
-    char line2[32];
-    char line3[32];
-    char header[32];
-    char back[32];
-    
-    uint32_t current_joystick_state;
-    uint32_t prev_joystick_state = 0;
-    uint32_t last_action_time = 0;
-    osMutexWait(glcd_mutex, osWaitForever);
-    GLCD_SetBackgroundColor(White);
-    GLCD_ClearScreen();
-    osMutexRelease(glcd_mutex);    
+// Records a button press and wakes Render_Thread. Returns 1 when the panel
+// was off, the press then only wakes it and is not acted on.
+static int ui_wake(void) {
+    int was_off = ui_power == UI_OFF;
 
-    while (1) {
-        osMutexWait(glcd_mutex, osWaitForever);
-        GLCD_SetBackgroundColor(White);
-        GLCD_SetForegroundColor(Black);
-        GLCD_DrawString(0, 3 * 24, "                    ");
-        
-        osMutexWait(adc_mutex, osWaitForever); // Acquire mutex
-        sprintf(header, "Display sensor Data");
-        sprintf(back, "Press center to return");
-        sprintf(line1, "Temp: %d", temp_adc);
-        sprintf(line2, "Moist %d", moist_adc);
-        sprintf(line3, "Ligh %d", light_adc);
-        osMutexRelease(adc_mutex); // Release mutex
-        GLCD_SetForegroundColor(Blue);
-        GLCD_DrawString(0, 24, header);
-        GLCD_SetForegroundColor(Black);
-        GLCD_DrawString(0, 4 * 24, line1);
-        GLCD_DrawString(0, (4 * 24) + 24, line2);
-        GLCD_DrawString(0, (4 * 24) + 48, line3);
-        GLCD_SetForegroundColor(Red);
-        GLCD_DrawString(0, (4 * 24) + 48 + 24, back);
-        osMutexRelease(glcd_mutex);
-
-        current_joystick_state = readJoystick();
-        uint32_t currentTime = osKernelSysTick();
-
-        if (currentTime - last_action_time >= DEBOUNCE_TIME) {
-            if ((current_joystick_state & 0x04) && !(prev_joystick_state & 0x04)) {
-                last_action_time = currentTime;
-                break;
-            }
-        }
-        prev_joystick_state = current_joystick_state;
-        osDelay(20);
+    last_input_s = uptime_s;
+    osSignalSet(render_thread_id, UI_DIRTY);
+    return was_off;
+}
+
+// Trend chart, swept left to right one pixel column per sample like a chart
+// recorder. Each sample sends only its own column and the gap column ahead
+// of it, so the work per sample is fixed however long the screen runs.
+#define GRAPH_TOP 24
+#define GRAPH_H 192               // Rows 1..8 of the text grid
+#define GRAPH_MAX ADC_MAX         // Full-scale ADC reading
+#define TREND_BG 0xFFFF           // RGB565
+#define TREND_SHADE 0xC7F8        // Actuator on
+#define TREND_TRACE 0x001F
+#define TREND_LIMIT 0xF800
+#define TREND_GAP 0x8410          // Sweep cursor ahead of the newest column
+
+static int graph_y(int value) {
+    if (value < 0) value = 0;
+    if (value > GRAPH_MAX) value = GRAPH_MAX;
+    return GRAPH_H - 1 - value * (GRAPH_H - 1) / GRAPH_MAX;
+}
+
+// One column: shading while the actuator is on, the threshold line, then the
+// trace joined to the previous sample so steep changes stay connected
+static void trend_column(uint16_t *col, int prev, int value, int limit, int active) {
+    int y0 = graph_y(prev), y1 = graph_y(value);
+
+    if (y0 > y1) {
+        int t = y0;
+        y0 = y1;
+        y1 = t;
     }
-    osMutexWait(glcd_mutex, osWaitForever);
-    GLCD_SetBackgroundColor(White);
-    GLCD_ClearScreen();
-    osMutexRelease(glcd_mutex);
-    Menu_Display(-1); // Force full redraw on return
+    for (int y = 0; y < GRAPH_H; y++) col[y] = active ? TREND_SHADE : TREND_BG;
+    if (limit <= GRAPH_MAX) col[graph_y(limit)] = TREND_LIMIT;
+    for (int y = y0; y <= y1; y++) col[y] = TREND_TRACE;
 }
 
-void toggle_gpio(int actuator) {
-    switch (actuator) {
-        case 0: // Heater
-            if (LPC_GPIO1->FIOPIN & (1 << 29)) {
-                LPC_GPIO1->FIOCLR = (1 << 29); // Turn off heater
-            } else {
-                LPC_GPIO1->FIOSET = (1 << 29); // Turn on heater
-            }
-            break;
-        case 1: // Sprinkler
-            if (LPC_GPIO1->FIOPIN & (1 << 31)) {
-                LPC_GPIO1->FIOCLR = (1 << 31); // Turn off sprinkler
-            } else {
-                LPC_GPIO1->FIOSET = (1 << 31); // Turn on sprinkler
-            }
-            break;
-        case 2: // Light
-            if (LPC_GPIO2->FIOPIN & (1 << 2)) {
-                LPC_GPIO2->FIOCLR = (1 << 2); // Turn off light
-            } else {
-                LPC_GPIO2->FIOSET = (1 << 2); // Turn on light
-            }
-            break;
-    }
-}
-
-void adjustHeaterThreshold(void) {
-    char thresholdString[20];
-    uint32_t current_joystick_state;
-    uint32_t prev_joystick_state = 0;
-    uint32_t last_action_time = 0;
-
-    osMutexWait(glcd_mutex, osWaitForever); // Use glcd_mutex for GLCD consistency
-    GLCD_SetBackgroundColor(White);
-    GLCD_ClearScreen();
-    GLCD_SetForegroundColor(Blue);
-    GLCD_DrawString(0, 0 * 24, "Set Heater Threshold");
-    GLCD_DrawString(0, 2 * 24, "Use joystick Up/Down");
-    GLCD_DrawString(0, 3 * 24, "to adjust value");
-    GLCD_SetForegroundColor(Red);
-    GLCD_DrawString(0, 5 * 24, "Center to confirm");
-    GLCD_SetForegroundColor(Black);
-    sprintf(thresholdString, "Threshold: %d", threadHoldtemp_adc);
-    GLCD_DrawString(0, 4 * 24, thresholdString);
-    osMutexRelease(glcd_mutex);
+void show_trend_graph(void) {
+    static const char *const labels[3] = { "Temp: ", "Moist: ", "Light: " };
+    static volatile int *const limits[3] = { &threadHoldtemp_adc, &threadHoldmoist_adc, &threadHoldlight_adc };
+    static uint16_t column[GRAPH_H]; // Still read by GPDMA after the blit call returns
+    char shown[GLCD_COLS];
+    char line[32];
+    int sensor = 0, x = 0, prev = -1, elapsed = 0, redraw = 1;
+    JoyEvent ev;
 
     while (1) {
-        current_joystick_state = readJoystick();
-        uint32_t currentTime = osKernelSysTick();
-
-        if (currentTime - last_action_time >= DEBOUNCE_TIME) {
-            if ((current_joystick_state & 0x01) && !(prev_joystick_state & 0x01)) { // Up pressed
-                threadHoldtemp_adc += 10; // Increment by 10 for noticeable change
-                if (threadHoldtemp_adc > 4095) threadHoldtemp_adc = 4095; // Max ADC value
-                last_action_time = currentTime;
-                osMutexWait(glcd_mutex, osWaitForever);
-                GLCD_SetBackgroundColor(White);
-                GLCD_SetForegroundColor(Black);
-                GLCD_DrawString(0, 4 * 24, "                    "); // Clear previous value
-                sprintf(thresholdString, "Threshold: %d", threadHoldtemp_adc);
-                GLCD_DrawString(0, 4 * 24, thresholdString);
-                osMutexRelease(glcd_mutex);
-            }
-            if ((current_joystick_state & 0x02) && !(prev_joystick_state & 0x02)) { // Down pressed
-                threadHoldtemp_adc -= 10; // Decrement by 10
-                if (threadHoldtemp_adc < 0) threadHoldtemp_adc = 0; // Min ADC value
-                last_action_time = currentTime;
-                osMutexWait(glcd_mutex, osWaitForever);
-                GLCD_SetBackgroundColor(White);
-                GLCD_SetForegroundColor(Black);
-                GLCD_DrawString(0, 4 * 24, "                    "); // Clear previous value
-                sprintf(thresholdString, "Threshold: %d", threadHoldtemp_adc);
-                GLCD_DrawString(0, 4 * 24, thresholdString);
-                osMutexRelease(glcd_mutex);
+        if (redraw) {
+            osMutexWait(glcd_mutex, osWaitForever);
+            if (ui_power != UI_OFF) { // Otherwise retried once the panel is back
+                glcd_background(White);
+                glcd_clear();
+                glcd_foreground(Red);
+                glcd_string(0, GRAPH_TOP + GRAPH_H, "L/R:Sensor C:Back");
+                memset(shown, ' ', sizeof(shown));
+                x = 0;
+                prev = -1;
+                elapsed = sensor_period_ms; // First column right away
+                redraw = 0;
             }
-            if ((current_joystick_state & 0x04) && !(prev_joystick_state & 0x04)) { // Center pressed
-                last_action_time = currentTime;
-                break;
+            osMutexRelease(glcd_mutex);
+        }
+
+        // The chart pauses while the panel is off, GRAM keeps what is shown
+        if (!redraw && ui_power != UI_OFF && elapsed >= sensor_period_ms) {
+            int value;
+            elapsed = 0;
+            osMutexWait(adc_mutex, osWaitForever);
+            value = sensor == 0 ? temp_adc : sensor == 1 ? moist_adc : light_adc;
+            osMutexRelease(adc_mutex);
+            if (prev < 0) prev = value;
+            trend_column(column, prev, value, *limits[sensor], actuator_is_on(sensor));
+            prev = value;
+            format_value(line, sizeof(line), labels[sensor], value);
+
+            osMutexWait(glcd_mutex, osWaitForever);
+            if (ui_power != UI_OFF) {
+                glcd_background(White);
+                glcd_foreground(Blue);
+                draw_changed(0, shown, line);
+                // The gap fill waits for the column blit, so 'column' is free
+                // again well before the next sample rebuilds it
+                glcd_bytes += 2 * (GRAPH_H * 2 + GLCD_WINDOW_BYTES);
+                hal_display_blit(x, GRAPH_TOP, 1, GRAPH_H, column);
+                x = (x + 1) % GLCD_WIDTH;
+                hal_display_fill(x, GRAPH_TOP, 1, GRAPH_H, TREND_GAP);
             }
+            osMutexRelease(glcd_mutex);
+        }
+
+        if (!joystick_get(&ev, 20)) {
+            elapsed += 20;
+            continue;
+        }
+        if (ev.type != JOY_PRESS || ui_wake()) continue; // A press on a dark panel only wakes it
+        if (ev.key == KEY_CENTER) break;
+        if (ev.key == KEY_LEFT) { // Previous sensor
+            sensor = (sensor + 2) % 3;
+            redraw = 1;
+        }
+        if (ev.key == KEY_RIGHT) { // Next sensor
+            sensor = (sensor + 1) % 3;
+            redraw = 1;
         }
-        prev_joystick_state = current_joystick_state;
-        osDelay(20);
     }
+    // The UI redraws every row when this returns
+}
 
-    // Return to the menu
-    osMutexWait(glcd_mutex, osWaitForever);
-    GLCD_SetBackgroundColor(White);
-    GLCD_ClearScreen();
-    osMutexRelease(glcd_mutex);
-    Menu_Display(-1); // Force full redraw on return
-}
-
-void adjustSprinklerThreshold(void) {
-    char thresholdString[20];
-    uint32_t current_joystick_state;
-    uint32_t prev_joystick_state = 0;
-    uint32_t last_action_time = 0;
-
-    osMutexWait(glcd_mutex, osWaitForever); // Use glcd_mutex for GLCD consistency
-    GLCD_SetBackgroundColor(White);
-    GLCD_ClearScreen();
-    GLCD_SetForegroundColor(Blue);
-    GLCD_DrawString(0, 0 * 24, "Set Sprinkler Threshold");
-    GLCD_DrawString(0, 2 * 24, "Use joystick Up/Down");
-    GLCD_DrawString(0, 3 * 24, "to adjust value");
-    GLCD_SetForegroundColor(Red);
-    GLCD_DrawString(0, 5 * 24, "Center to confirm");
-    GLCD_SetForegroundColor(Black);
-    sprintf(thresholdString, "Threshold: %d", threadHoldmoist_adc);
-    GLCD_DrawString(0, 4 * 24, thresholdString);
-    osMutexRelease(glcd_mutex);
+// Actuators 0-2 are the heater, sprinkler and light outputs
+int actuator_is_on(int actuator) {
+    return actuator >= HAL_HEATER && actuator <= HAL_LIGHT ? hal_out_get(actuator) : 0;
+}
 
-    while (1) {
-        current_joystick_state = readJoystick();
-        uint32_t currentTime = osKernelSysTick();
-
-        if (currentTime - last_action_time >= DEBOUNCE_TIME) {
-            if ((current_joystick_state & 0x01) && !(prev_joystick_state & 0x01)) { // Up pressed
-                threadHoldmoist_adc += 10; // Increment by 10 for noticeable change
-                if (threadHoldmoist_adc > 4095) threadHoldmoist_adc = 4095; // Max ADC value
-                last_action_time = currentTime;
-                osMutexWait(glcd_mutex, osWaitForever);
-                GLCD_SetBackgroundColor(White);
-                GLCD_SetForegroundColor(Black);
-                GLCD_DrawString(0, 4 * 24, "                    "); // Clear previous value
-                sprintf(thresholdString, "Threshold: %d", threadHoldmoist_adc);
-                GLCD_DrawString(0, 4 * 24, thresholdString);
-                osMutexRelease(glcd_mutex);
-            }
-            if ((current_joystick_state & 0x02) && !(prev_joystick_state & 0x02)) { // Down pressed
-                threadHoldmoist_adc -= 10; // Decrement by 10
-                if (threadHoldmoist_adc < 0) threadHoldmoist_adc = 0; // Min ADC value
-                last_action_time = currentTime;
-                osMutexWait(glcd_mutex, osWaitForever);
-                GLCD_SetBackgroundColor(White);
-                GLCD_SetForegroundColor(Black);
-                GLCD_DrawString(0, 4 * 24, "                    "); // Clear previous value
-                sprintf(thresholdString, "Threshold: %d", threadHoldmoist_adc);
-                GLCD_DrawString(0, 4 * 24, thresholdString);
-                osMutexRelease(glcd_mutex);
-            }
-            if ((current_joystick_state & 0x04) && !(prev_joystick_state & 0x04)) { // Center pressed
-                last_action_time = currentTime;
-                break;
-            }
-        }
-        prev_joystick_state = current_joystick_state;
-        osDelay(20);
+void actuator_set(int actuator, int on) {
+    if (actuator < HAL_HEATER || actuator > HAL_LIGHT) return;
+    if (on) actuator_ons[actuator]++;
+    hal_out_set(actuator, on);
+    crash_trace(TRACE_ACTUATOR, actuator << 8 | (on != 0));
+}
+
+// Table-driven UI. Screens are const tables in flash and the code below is
+// the only place that handles joystick input, navigation and drawing for
+// them. The panel is kept as GLCD_ROWS text rows: each pass formats the rows
+// of the current screen and only sends rows whose text or colours differ
+// from what is shown, cell by cell when just the text changed.
+//
+// Menu_Thread turns joystick input into model changes (ui_stack, params)
+// under ui_mutex and signals UI_DIRTY. Render_Thread is the only thread
+// drawing these screens; it draws at most once per FRAME_MS, so changes
+// made within one frame period come out as a single frame.
+#define GLCD_ROWS (GLCD_HEIGHT / 24)
+#define UI_DEPTH 4                // Nested screens remembered for going back
+#define UI_SELECTED 0xC0C0C0      // Background of the highlighted item
+#define FRAME_MS 40               // Shortest time between two frames
+#define FRAME_BUDGET_US 20000     // Frames that take longer count as overruns
+#define UI_REFRESH_MS 250         // Live values are redrawn this often without input
+
+typedef enum {
+    UI_MENU,                      // Up/Down select, Center opens the item's target
+    UI_TOGGLE,                    // Up/Down select, Left/Right switch the item's param
+    UI_EDIT,                      // Up/Down change the first item's param, see ui_step()
+    UI_STATUS,                    // Live readings, Center goes back
+    UI_CUSTOM                     // Screen with its own loop, run() returns on exit
+} UiKind;
+
+typedef struct UiScreen UiScreen;
+
+typedef struct {
+    const char *label;
+    const UiScreen *target;       // Menu: screen opened with Center, NULL does nothing
+    const char *param;            // Toggle list and editor: param_table entry
+    volatile int *value;          // Status view: reading shown after the label
+} UiItem;
+
+struct UiScreen {
+    UiKind kind;
+    const char *title;
+    const UiItem *items;
+    int count;
+    int step;                     // Editor: change per Up/Down press, grows while held
+    const char *help[2];          // Footer lines in red
+    void (*run)(void);            // Custom screens
+};
+
+typedef struct {
+    char text[GLCD_COLS];         // Space padded, not terminated
+    uint32_t fg, bg;
+} UiRow;
+
+#define UI_ITEMS(a) (a), (int)(sizeof(a) / sizeof((a)[0]))
+
+static const UiItem sensor_items[] = {
+    { "Temp: ",  NULL, NULL, &temp_adc  },
+    { "Moist: ", NULL, NULL, &moist_adc },
+    { "Light: ", NULL, NULL, &light_adc },
+};
+
+static const UiItem actuator_items[] = {
+    { "Heater",    NULL, "HEATER",    NULL },
+    { "Sprinkler", NULL, "SPRINKLER", NULL },
+    { "Light",     NULL, "LIGHT",     NULL },
+};
+
+static const UiItem heater_th_item[]    = { { "Threshold: ", NULL, "HEATER_TH",    NULL } };
+static const UiItem sprinkler_th_item[] = { { "Threshold: ", NULL, "SPRINKLER_TH", NULL } };
+static const UiItem light_th_item[]     = { { "Threshold: ", NULL, "LIGHT_TH",     NULL } };
+
+static const UiScreen ui_sensors = {
+    .kind = UI_STATUS, .title = "Display sensor Data", .items = UI_ITEMS(sensor_items),
+    .help = { "Press center to return" },
+};
+static const UiScreen ui_manual = {
+    .kind = UI_TOGGLE, .title = "Actuators Control", .items = UI_ITEMS(actuator_items),
+    .help = { "Up/Dn:Select L/R:ON/OFF", "Center:Exit" },
+};
+static const UiScreen ui_heater_th = {
+    .kind = UI_EDIT, .title = "Set Heater Threshold", .items = UI_ITEMS(heater_th_item),
+    .step = 10, .help = { "Center to confirm" },
+};
+static const UiScreen ui_sprinkler_th = {
+    .kind = UI_EDIT, .title = "Set Sprinkler Thresh", .items = UI_ITEMS(sprinkler_th_item),
+    .step = 10, .help = { "Center to confirm" },
+};
+static const UiScreen ui_light_th = {
+    .kind = UI_EDIT, .title = "Set Light Threshold", .items = UI_ITEMS(light_th_item),
+    .step = 10, .help = { "Center to confirm" },
+};
+static const UiScreen ui_trend = { .kind = UI_CUSTOM, .run = show_trend_graph };
+
+static const UiItem main_items[] = {
+    { "Show Sensors Data",       &ui_sensors      },
+    { "Manual Control",          &ui_manual       },
+    { "Adjust Heater Thresh",    &ui_heater_th    },
+    { "Adjust Sprinkler Thresh", &ui_sprinkler_th },
+    { "Adjust Light Thresh",     &ui_light_th     },
+    { "Trend Graph",             &ui_trend        },
+    { "Exit Menu",               NULL             },
+};
+
+static const UiScreen ui_main = {
+    .kind = UI_MENU, .title = "Greenhouse Menu", .items = UI_ITEMS(main_items),
+};
+
+static UiRow ui_rows[GLCD_ROWS];  // What the panel shows, owned by Render_Thread
+static int ui_valid;              // Cleared when something else drew on the panel
+static struct {                   // Guarded by ui_mutex
+    const UiScreen *screen;
+    int cursor;
+} ui_stack[UI_DEPTH] = { { &ui_main, 0 } };
+static int ui_depth;              // Current screen is ui_stack[ui_depth]
+
+static const Param *ui_param(const char *name) {
+    return &param_table[find_entry(param_table, sizeof(param_table) / sizeof(param_table[0]), sizeof(Param), name)];
+}
+
+// Brings one row of the panel to text in fg on bg. Caller holds glcd_mutex.
+static void ui_row(int row, const char *text, uint32_t fg, uint32_t bg) {
+    UiRow *r = &ui_rows[row];
+
+    glcd_foreground(fg);
+    glcd_background(bg);
+    if (ui_valid && r->fg == fg && r->bg == bg) {
+        draw_changed(row, r->text, text);
+        return;
+    }
+    glcd_line(row * 24, text);
+    r->fg = fg;
+    r->bg = bg;
+    for (int col = 0; col < GLCD_COLS; col++) r->text[col] = *text ? *text++ : ' ';
+}
+
+// Returns the microseconds spent drawing, without the waits for the locks
+static int ui_render(const UiScreen *s, int cursor) {
+    int lists = s->kind == UI_MENU || s->kind == UI_TOGGLE;
+    int value[GLCD_ROWS];
+    char line[GLCD_COLS + 8];
+    int row = 0;
+    uint32_t start, cycles;
+
+    if (s->kind == UI_STATUS) {
+        osMutexWait(adc_mutex, osWaitForever); // Only copy under the ADC lock
+        for (int i = 0; i < s->count; i++) value[i] = *s->items[i].value;
+        osMutexRelease(adc_mutex);
     }
 
-    // Return to the menu
     osMutexWait(glcd_mutex, osWaitForever);
-    GLCD_SetBackgroundColor(White);
-    GLCD_ClearScreen();
-    osMutexRelease(glcd_mutex);
-    Menu_Display(-1); // Force full redraw on return
-}
-
-void adjustLightThreshold(void) {
-    char thresholdString[20];
-    uint32_t current_joystick_state;
-    uint32_t prev_joystick_state = 0;
-    uint32_t last_action_time = 0;
-
-    osMutexWait(glcd_mutex, osWaitForever); // Use glcd_mutex for GLCD consistency
-    GLCD_SetBackgroundColor(White);
-    GLCD_ClearScreen();
-    GLCD_SetForegroundColor(Blue);
-    GLCD_DrawString(0, 0 * 24, "Set Light Threshold");
-    GLCD_DrawString(0, 2 * 24, "Use joystick Up/Down");
-    GLCD_DrawString(0, 3 * 24, "to adjust value");
-    GLCD_SetForegroundColor(Red);
-    GLCD_DrawString(0, 5 * 24, "Center to confirm");
-    GLCD_SetForegroundColor(Black);
-    sprintf(thresholdString, "Threshold: %d", threadHoldlight_adc);
-    GLCD_DrawString(0, 4 * 24, thresholdString);
+    start = hal_cycles();
+    ui_row(row++, s->title, Blue, White);
+    ui_row(row++, "", Black, White);
+    if (s->kind == UI_EDIT) {
+        ui_row(row++, "Use joystick Up/Down", Blue, White);
+        ui_row(row++, "to adjust value", Blue, White);
+    }
+    for (int i = 0; i < s->count && row < GLCD_ROWS; i++) {
+        const UiItem *item = &s->items[i];
+        int selected = lists && i == cursor;
+        FmtBuf f;
+
+        fmt_init(&f, line, sizeof(line));
+        if (selected) fmt_str(&f, "> ");
+        fmt_str(&f, item->label);
+        if (s->kind == UI_TOGGLE) fmt_str(&f, param_get(ui_param(item->param)) ? ": ON" : ": OFF");
+        else if (s->kind == UI_EDIT) format_reading(&f, param_get(ui_param(item->param)));
+        else if (s->kind == UI_STATUS) format_reading(&f, value[i]);
+        ui_row(row++, line, lists ? Blue : Black, selected ? UI_SELECTED : White);
+    }
+    if (row < GLCD_ROWS && s->help[0]) ui_row(row++, "", Black, White);
+    for (int i = 0; i < 2 && row < GLCD_ROWS; i++) {
+        if (s->help[i]) ui_row(row++, s->help[i], Red, White);
+    }
+    while (row < GLCD_ROWS) ui_row(row++, "", Black, White);
+    glcd_background(White);
+    ui_valid = 1;
+    cycles = hal_cycles() - start;
     osMutexRelease(glcd_mutex);
+    return cycles / (hal_clock_hz() / 1000000);
+}
 
-    while (1) {
-        current_joystick_state = readJoystick();
-        uint32_t currentTime = osKernelSysTick();
-
-        if (currentTime - last_action_time >= DEBOUNCE_TIME) {
-            if ((current_joystick_state & 0x01) && !(prev_joystick_state & 0x01)) { // Up pressed
-                threadHoldlight_adc += 10; // Increment by 10 for noticeable change
-                if (threadHoldlight_adc > 4095) threadHoldlight_adc = 4095; // Max ADC value
-                last_action_time = currentTime;
-                osMutexWait(glcd_mutex, osWaitForever);
-                GLCD_SetBackgroundColor(White);
-                GLCD_SetForegroundColor(Black);
-                GLCD_DrawString(0, 4 * 24, "                    "); // Clear previous value
-                sprintf(thresholdString, "Threshold: %d", threadHoldlight_adc);
-                GLCD_DrawString(0, 4 * 24, thresholdString);
-                osMutexRelease(glcd_mutex);
-            }
-            if ((current_joystick_state & 0x02) && !(prev_joystick_state & 0x02)) { // Down pressed
-                threadHoldlight_adc -= 10; // Decrement by 10
-                if (threadHoldlight_adc < 0) threadHoldlight_adc = 0; // Min ADC value
-                last_action_time = currentTime;
-                osMutexWait(glcd_mutex, osWaitForever);
-                GLCD_SetBackgroundColor(White);
-                GLCD_SetForegroundColor(Black);
-                GLCD_DrawString(0, 4 * 24, "                    "); // Clear previous value
-                sprintf(thresholdString, "Threshold: %d", threadHoldlight_adc);
-                GLCD_DrawString(0, 4 * 24, thresholdString);
-                osMutexRelease(glcd_mutex);
-            }
-            if ((current_joystick_state & 0x04) && !(prev_joystick_state & 0x04)) { // Center pressed
-                last_action_time = currentTime;
-                break;
-            }
-        }
-        prev_joystick_state = current_joystick_state;
-        osDelay(20);
+static void ui_open(const UiScreen *s) {
+    if (ui_depth < UI_DEPTH - 1) {
+        ui_depth++;
+        ui_stack[ui_depth].screen = s;
+        ui_stack[ui_depth].cursor = 0;
     }
+}
 
-    // Return to the menu
-    osMutexWait(glcd_mutex, osWaitForever);
-    GLCD_SetBackgroundColor(White);
-    GLCD_ClearScreen();
-    osMutexRelease(glcd_mutex);
-    Menu_Display(-1); // Force full redraw on return
+// Editor step for a key held for held_ms. Together with the faster repeat of
+// the joystick driver a held key crosses 0..4095 in under four seconds,
+// while single presses still move by one step.
+static int ui_step(int step, int held_ms) {
+    if (held_ms >= JOY_FASTER_MS) return step * 10;
+    if (held_ms >= JOY_FAST_MS) return step * 5;
+    return step;
+}
+
+// keys holds the buttons pressed or repeating, held_ms how long they have
+// been down. Caller holds ui_mutex.
+static void ui_input(uint32_t keys, int held_ms) {
+    const UiScreen *s = ui_stack[ui_depth].screen;
+    int *cursor = &ui_stack[ui_depth].cursor;
+    const UiItem *item = &s->items[*cursor];
+
+    if (s->kind == UI_MENU || s->kind == UI_TOGGLE) {
+        if ((keys & KEY_UP) && *cursor > 0) (*cursor)--;
+        if ((keys & KEY_DOWN) && *cursor < s->count - 1) (*cursor)++;
+    }
+    if (s->kind == UI_TOGGLE && (keys & (KEY_LEFT | KEY_RIGHT))) {
+        const Param *p = ui_param(item->param);
+        param_store(p, !param_get(p), Discard_Reply);
+    }
+    if (s->kind == UI_EDIT && (keys & (KEY_UP | KEY_DOWN)) && !joy_test_hz) { // Test presses never edit
+        const Param *p = ui_param(item->param);
+        int step = ui_step(s->step, held_ms);
+        int value = param_get(p) + ((keys & KEY_UP) ? step : -step);
+        if (value < p->min) value = p->min;
+        if (value > p->max) value = p->max;
+        param_store(p, value, Discard_Reply);
+    }
+    if (keys & KEY_CENTER) {
+        if (s->kind != UI_MENU) {
+            if (ui_depth > 0) ui_depth--;
+        } else if (item->target != NULL) {
+            ui_open(item->target); // Menu_Thread runs custom screens
+        }
+    }
 }
 
+// Input side of the UI. Blocks on joystick events: presses drive the
+// screens, Up/Down also act on auto-repeat, and holding Center goes back to
+// the main menu. A press that changed the screen is ignored until released,
+// so holding Center on an item opens it and stays there.
 void Menu_Thread(const void *arg) {
-    GPIO_Joystick_Init(); // Initialize joystick
-    GLCD_Initialize();    // Initialize GLCD
-    GLCD_SetFont(&GLCD_Font_16x24); // Set font
-    Menu_Display(-1);     // Initial full menu display
+    JoyEvent ev;
+    uint32_t ignore = 0; // Keys whose press woke the panel or changed the screen, until released
+    const UiScreen *s;
 
-    int last_menu = selected_menu;
-    while (1) {
-        int dir = readJoystick();
-        int updated = 0;
+    joystick_init();
 
-        if (dir == 0) {
-            // No button pressed
-            osDelay(100);
+    while (1) {
+        thread_loops[STAT_MENU]++;
+        if (!joystick_get(&ev, osWaitForever)) continue;
+        if ((ev.type == JOY_PRESS || ev.type == JOY_REPEAT) && ui_wake()) ignore |= ev.key;
+        if (ignore & ev.key) {
+            if (ev.type == JOY_RELEASE) ignore &= ~ev.key;
             continue;
         }
 
-        if (dir & 0x01 && selected_menu > 0) { // Up
-            selected_menu--;
-            updated = 1;
-        } else if (dir & 0x02 && selected_menu < 5) { // Down (max 5 for 6 items)
-            selected_menu++;
-            updated = 1;
-        } else if (dir & 0x04) { // Center pressed
-            switch (selected_menu) {
-                case 0: // Show Sensors
-                    show_sensors_on_glcd();
-                    break; // Full redraw handled in show_sensors_on_glcd
-                case 1: // Actuator Control
-                    actuator_control();
-                    break; // Full redraw handled in actuator_control
-                case 2: // Adjust Heater Threshold
-                    adjustHeaterThreshold();
-                    break; // Full redraw handled in adjustHeaterThreshold
-                case 3: // Adjust Sprinkler Threshold
-                    adjustSprinklerThreshold();
-                    break; // Full redraw handled in adjustSprinklerThreshold
-                case 4: // Adjust Light Threshold
-                    adjustLightThreshold();
-                    break; // Full redraw handled in adjustLightThreshold
-                case 5: // Exit Menu
-                    break;
-                default: 
-                    break;								
-            }
+        osMutexWait(ui_mutex, osWaitForever);
+        if (ev.type == JOY_LONG && ev.key == KEY_CENTER) {
+            ui_depth = 0;
+        } else if (ev.type == JOY_PRESS || (ev.type == JOY_REPEAT && (ev.key & (KEY_UP | KEY_DOWN)))) {
+            const UiScreen *was = ui_stack[ui_depth].screen;
+            ui_input(ev.key, ev.held_ms);
+            if (ui_stack[ui_depth].screen != was) ignore |= ev.key;
         }
-
-        if (updated || selected_menu != last_menu) {
-            Menu_Display(last_menu);
-            last_menu = selected_menu;
+        s = ui_stack[ui_depth].screen;
+        osMutexRelease(ui_mutex);
+        if (s->kind == UI_CUSTOM) {
+            // Custom screens keep their own loop and draw for themselves,
+            // Render_Thread skips frames while one is open
+            s->run();
+            osMutexWait(ui_mutex, osWaitForever);
+            ui_depth--;
+            ui_valid = 0; // It drew over everything
+            osMutexRelease(ui_mutex);
+            ignore = 0; // It took the releases
         }
+        osSignalSet(render_thread_id, UI_DIRTY); // Repeats within one frame give one redraw
+    }
+}
 
-        osDelay(250);
+// Draws the UI. Waits for UI_DIRTY, or UI_REFRESH_MS for live values, draws
+// one frame and then sleeps out the rest of the frame period. The time spent
+// drawing is checked against FRAME_BUDGET_US.
+void Render_Thread(const void *arg) {
+    const UiScreen *s;
+    int cursor;
+
+    hal_display_init();
+    hal_display_power(UI_AWAKE);
+    osThreadSetPriority(osThreadGetId(), osPriorityNormal); // Started low, behind the control threads
+
+    while (1) {
+        thread_loops[STAT_RENDER]++;
+        ui_power_update();
+        if (ui_power == UI_OFF) {
+            osSignalWait(UI_DIRTY, osWaitForever); // Only a button press wakes the panel
+            continue;
+        }
+        osMutexWait(ui_mutex, osWaitForever);
+        s = ui_stack[ui_depth].screen;
+        cursor = ui_stack[ui_depth].cursor;
+        osMutexRelease(ui_mutex);
+
+        if (s->kind != UI_CUSTOM) {
+            frame_us = ui_render(s, cursor); // Sends only what changed
+            boot_mark(BOOT_PANEL);
+            if (frame_us > FRAME_BUDGET_US) {
+                frame_overruns++;
+                crash_trace(TRACE_FRAME, frame_us / 100);
+            }
+            osDelay(frame_us < FRAME_MS * 1000 ? FRAME_MS - frame_us / 1000 : 1);
+        }
+        osSignalWait(UI_DIRTY, UI_REFRESH_MS);
     }
 }
 
+osTimerDef(Uptime_Timer, Uptime_Timer);
+
 osThreadDef(Sensor_Thread, osPriorityNormal, 1, 0);
 osThreadDef(UART_Thread, osPriorityNormal, 1, 0);
 osThreadDef(HeaterMonitor_Thread, osPriorityNormal, 1, 0);
@@ -749,40 +1859,61 @@ osThreadDef(LightMonitor_Thread, osPriorityNormal, 1, 0);
 osThreadDef(LightControl_Thread, osPriorityNormal, 1, 0);
 osThreadDef(UART_ReceiveThread, osPriorityNormal, 1, 0);
 osThreadDef(Menu_Thread, osPriorityNormal, 1, 0);
+osThreadDef(RS485_Thread, osPriorityNormal, 1, 0);
+osThreadDef(Render_Thread, osPriorityBelowNormal, 1, 0); // Raised once the panel is up
+osThreadDef(Config_Thread, osPriorityBelowNormal, 1, 0);
 
 osMutexDef(adc_mutex);
 osMutexDef(glcd_mutex); // Define glcd_mutex
+osMutexDef(uart_mutex);
+osMutexDef(ui_mutex);
+osMutexDef(log_mutex);
 osSemaphoreDef(heater_sem);
 osSemaphoreDef(sprinkler_sem);
 osSemaphoreDef(light_sem);
 
 int main(void) {
-    SystemCoreClockUpdate(); // Update the system clock frequency
-    ADC_Init(); // Initialize ADC
-    GPIO_Init(); // Initialize GPIO
-    UART0_Init(); // Initialize UART
+    hal_gpio_init(); // Actuators off before anything else
+    hal_time_init(); // Cycle counter for the CPU load figure and boot profile
+    crash_init(); // Saves the record of a crash before the reset, if any
+    crash_records = crash_count();
+    hal_adc_init(); // Initialize ADC
+    hal_uart_init(HAL_UART_CONSOLE); // Initialize UART
+    hal_uart_init(HAL_UART_RS485); // Initialize RS-485 port
+    config_restore(); // Settings saved before the last reset
+    log_restore();
     
     osKernelInitialize(); // Initialize the RTX kernel
    
     adc_mutex = osMutexCreate(osMutex(adc_mutex));
     glcd_mutex = osMutexCreate(osMutex(glcd_mutex)); // Create glcd_mutex
+    uart_mutex = osMutexCreate(osMutex(uart_mutex));
+    ui_mutex = osMutexCreate(osMutex(ui_mutex));
+    log_mutex = osMutexCreate(osMutex(log_mutex));
     heater_sem = osSemaphoreCreate(osSemaphore(heater_sem), 1);
     sprinkler_sem = osSemaphoreCreate(osSemaphore(sprinkler_sem), 1);
     light_sem = osSemaphoreCreate(osSemaphore(light_sem), 1);
     
-    // Create threads for each function
-    osThreadCreate(osThread(Sensor_Thread), NULL);
-    osThreadCreate(osThread(UART_Thread), NULL);
+    osTimerStart(osTimerCreate(osTimer(Uptime_Timer), osTimerPeriodic, NULL), 1000);
+
+    // Create threads for each function, control first so it runs first
+    sensor_thread_id = osThreadCreate(osThread(Sensor_Thread), NULL);
     osThreadCreate(osThread(HeaterMonitor_Thread), NULL);
     osThreadCreate(osThread(HeaterControl_Thread), NULL);
     osThreadCreate(osThread(SprinklerMonitor_Thread), NULL);
     osThreadCreate(osThread(SprinklerControl_Thread), NULL);
     osThreadCreate(osThread(LightMonitor_Thread), NULL);
     osThreadCreate(osThread(LightControl_Thread), NULL);
+    uart_thread_id = osThreadCreate(osThread(UART_Thread), NULL);
     osThreadCreate(osThread(UART_ReceiveThread), NULL);
+    osThreadCreate(osThread(RS485_Thread), NULL);
+    config_thread_id = osThreadCreate(osThread(Config_Thread), NULL);
     osThreadCreate(osThread(Menu_Thread), NULL);
+    render_thread_id = osThreadCreate(osThread(Render_Thread), NULL);
     
     osKernelStart(); // Start the RTOS kernel
+    boot_mark(BOOT_KERNEL);
     
-    while (1); // Infinite loop to keep the main function alive
+    osThreadTerminate(osThreadGetId()); // Nothing left for main, do not spin in its time slices
+    while (1);
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include <string.h>
+#include "fmt.h"
+#include "rs485_proto.h"
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int hex_byte(const char *str) {
+    int hi = hex_value(str[0]), lo = hex_value(str[1]);
+    return (hi < 0 || lo < 0) ? -1 : (hi << 4) | lo;
+}
+
+int rs485_frame(char *out, int size, char lead, int addr, const char *payload) {
+    FmtBuf f;
+    int len = strlen(payload);
+    uint8_t sum = 0;
+
+    if (len > 0 && payload[len - 1] == '\n') len--;
+    if (len + 9 > size) return 0; // lead, AA, ':', '*', CC, '\n', NUL
+    fmt_init(&f, out, size);
+    fmt_char(&f, lead);
+    fmt_hex(&f, addr, 2);
+    fmt_char(&f, ':');
+    for (int i = 0; i < len; i++) {
+        sum ^= (uint8_t)payload[i];
+        fmt_char(&f, payload[i]);
+    }
+    fmt_char(&f, '*');
+    fmt_hex(&f, sum, 2);
+    fmt_char(&f, '\n');
+    return f.len;
+}
+
+int rs485_parse(char *line, char lead, int *addr, char **payload) {
+    int len = strlen(line);
+    uint8_t sum = 0;
+
+    if (len < 7 || line[0] != lead || line[3] != ':' || line[len - 3] != '*') return 0;
+    *addr = hex_byte(line + 1);
+    if (*addr < 0) return 0;
+    for (int i = 4; i < len - 3; i++) sum ^= (uint8_t)line[i];
+    if (hex_byte(line + len - 2) != sum) return 0;
+    line[len - 3] = '\0';
+    *payload = line + 4;
+    return 1;
+}
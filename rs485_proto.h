@@ -0,0 +1,27 @@
+#ifndef RS485_PROTO_H
+#define RS485_PROTO_H
+
+// Framing for the multi-drop RS-485 link, shared by the firmware and the
+// host tools. Every line on the bus is one frame:
+//
+//   @AA:<payload>*CC\n    host -> node AA (00 broadcasts, no node answers)
+//   #AA:<payload>*CC\n    node AA -> host, one frame per reply line
+//   #AA:END*CC\n          last frame of a node's answer
+//
+// AA is the node address and CC the XOR of the payload bytes, both in hex.
+
+#define RS485_MAX_FRAME 96      // Longest frame including "\n"
+#define RS485_BROADCAST 0
+#define RS485_MAX_ADDR 247
+#define RS485_REQUEST '@'
+#define RS485_RESPONSE '#'
+
+// Builds a frame into out, payload may end in '\n' which is dropped.
+// Returns the frame length, 0 if it does not fit.
+int rs485_frame(char *out, int size, char lead, int addr, const char *payload);
+
+// Checks a received line (without '\n') in place. On success stores the
+// address, points payload at the NUL-terminated payload and returns 1.
+int rs485_parse(char *line, char lead, int *addr, char **payload);
+
+#endif
@@ -0,0 +1,270 @@
+#include <string.h>
+#include "sample_log.h"
+
+#define SLOG_MAGIC 0x5A4C
+#define PAYLOAD_BITS ((SLOG_PAGE - sizeof(SlogHeader)) * 8)
+
+typedef struct {
+    uint16_t magic;
+    uint16_t crc;                       // CRC-16 of the rest of the page
+    uint32_t seq;                       // Block number, the page is seq % pages
+    uint32_t t0;                        // First sample
+    uint32_t dt_base;                   // Shortest time delta in the block
+    uint16_t v0[SLOG_CHANNELS];
+    uint8_t count;                      // Samples, the first one included
+    uint8_t wt;                         // Bits per time delta beyond dt_base
+    uint8_t wv[SLOG_CHANNELS];          // Bits per zigzag value delta
+    uint8_t pad;
+} SlogHeader;                           // Followed by count - 1 packed deltas
+
+static const SlogFlash *flash;
+static uint32_t pages, pages_per_sector;
+static uint32_t first_seq, next_seq;    // Blocks in flash, next_seq is the RAM block
+
+static SlogSample pending[SLOG_BLOCK_MAX];
+static int pending_count;
+static uint32_t dt_min, dt_max;         // Over the RAM block
+static uint32_t zz_max[SLOG_CHANNELS];
+
+static uint32_t page_buf[SLOG_PAGE / 4]; // Word aligned for IAP
+
+static const SlogHeader *header(uint32_t seq) {
+    return (const SlogHeader *)(flash->mem + (seq % pages) * SLOG_PAGE);
+}
+
+static uint16_t crc16(const uint8_t *p, int len) {
+    uint16_t crc = 0xFFFF;
+    while (len--) {
+        crc ^= (uint16_t)*p++ << 8;
+        for (int i = 0; i < 8; i++) crc = (crc << 1) ^ ((crc & 0x8000) ? 0x1021 : 0);
+    }
+    return crc;
+}
+
+static int block_ok(const SlogHeader *h, uint32_t seq) {
+    return h->magic == SLOG_MAGIC && h->seq == seq && h->count > 0 &&
+           h->crc == crc16((const uint8_t *)h + 4, SLOG_PAGE - 4);
+}
+
+static int width(uint32_t x) {
+    int w = 0;
+    while (x) { w++; x >>= 1; }
+    return w;
+}
+
+static uint32_t zigzag(int32_t d) {
+    return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+}
+
+static int32_t unzigzag(uint32_t z) {
+    return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+}
+
+static int sample_bits(const SlogHeader *h) {
+    int bits = h->wt;
+    for (int c = 0; c < SLOG_CHANNELS; c++) bits += h->wv[c];
+    return bits;
+}
+
+// LSB first, bits up to 32
+static void put_bits(uint8_t *buf, uint32_t *pos, uint32_t value, int bits) {
+    while (bits > 0) {
+        int used = *pos & 7, n = 8 - used < bits ? 8 - used : bits;
+        buf[*pos >> 3] |= (uint8_t)((value & ((1u << n) - 1)) << used);
+        value = n < 32 ? value >> n : 0;
+        *pos += n;
+        bits -= n;
+    }
+}
+
+static uint32_t get_bits(const uint8_t *buf, uint32_t *pos, int bits) {
+    uint32_t value = 0;
+    int got = 0;
+    while (got < bits) {
+        int used = *pos & 7, n = 8 - used < bits - got ? 8 - used : bits - got;
+        value |= (uint32_t)((buf[*pos >> 3] >> used) & ((1u << n) - 1)) << got;
+        *pos += n;
+        got += n;
+    }
+    return value;
+}
+
+static int sector_head(int s, uint32_t *seq) {
+    const SlogHeader *h = (const SlogHeader *)(flash->mem + s * flash->sector_size);
+    *seq = h->seq;
+    return block_ok(h, h->seq) && h->seq % pages == s * pages_per_sector;
+}
+
+// Sectors fill in page order, so the newest sector is the one whose first
+// block has the highest number and its used pages are a prefix. A reset in
+// the middle of a write leaves at most one bad page there, which the readers
+// skip by its CRC.
+int slog_init(const SlogFlash *f) {
+    int newest = -1;
+    uint32_t newest_seq = 0, seq, lo, hi;
+
+    flash = f;
+    pages_per_sector = f->sector_size / SLOG_PAGE;
+    pages = pages_per_sector * f->sectors;
+    first_seq = next_seq = 0;
+    pending_count = 0;
+    for (int s = 0; s < f->sectors; s++) {
+        if (sector_head(s, &seq) && (newest < 0 || seq > newest_seq)) {
+            newest = s;
+            newest_seq = seq;
+        }
+    }
+    if (newest < 0) return 0;
+
+    lo = 0;
+    hi = pages_per_sector - 1;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if (header(newest * pages_per_sector + mid)->magic != 0xFFFF) lo = mid; else hi = mid - 1;
+    }
+    next_seq = newest_seq + lo + 1;
+    first_seq = newest_seq;
+    for (int s = 0; s < f->sectors; s++) {
+        if (sector_head(s, &seq) && seq + pages >= next_seq && seq < first_seq) first_seq = seq;
+    }
+    return next_seq - first_seq;
+}
+
+int slog_flush(void) {
+    SlogHeader *h = (SlogHeader *)page_buf;
+    uint8_t *bits = (uint8_t *)(h + 1);
+    uint32_t pos = 0, seq = next_seq;
+
+    if (pending_count == 0) return 0;
+    memset(page_buf, 0, sizeof(page_buf));
+    h->magic = SLOG_MAGIC;
+    h->seq = seq;
+    h->t0 = pending[0].time_s;
+    h->dt_base = dt_min;
+    h->count = pending_count;
+    h->wt = width(dt_max - dt_min);
+    for (int c = 0; c < SLOG_CHANNELS; c++) {
+        h->v0[c] = pending[0].value[c];
+        h->wv[c] = width(zz_max[c]);
+    }
+    for (int i = 1; i < pending_count; i++) {
+        put_bits(bits, &pos, pending[i].time_s - pending[i - 1].time_s - dt_min, h->wt);
+        for (int c = 0; c < SLOG_CHANNELS; c++) {
+            put_bits(bits, &pos, zigzag(pending[i].value[c] - pending[i - 1].value[c]), h->wv[c]);
+        }
+    }
+    h->crc = crc16((const uint8_t *)page_buf + 4, SLOG_PAGE - 4);
+    pending_count = 0;
+
+    if (seq % pages_per_sector == 0) {
+        // Entering a sector drops the blocks it held on the previous lap
+        if (first_seq + pages < seq + pages_per_sector) first_seq = seq + pages_per_sector - pages;
+        if (flash->erase(seq / pages_per_sector % flash->sectors) != 0) return -1;
+    }
+    next_seq = seq + 1; // Even when the write fails, a page is never programmed twice
+    if (flash->program(seq % pages, page_buf) != 0) return -1;
+    return block_ok(header(seq), seq) ? 0 : -1;
+}
+
+int slog_flush_before(uint32_t time_s) {
+    if (pending_count == 0 || pending[0].time_s >= time_s) return 0;
+    return slog_flush();
+}
+
+int slog_append(const SlogSample *sample) {
+    int result = 0;
+
+    if (pending_count > 0) {
+        const SlogSample *last = &pending[pending_count - 1];
+        uint32_t dt = sample->time_s - last->time_s;
+        uint32_t lo = pending_count == 1 || dt < dt_min ? dt : dt_min;
+        uint32_t hi = pending_count == 1 || dt > dt_max ? dt : dt_max;
+        uint32_t zz[SLOG_CHANNELS];
+        uint32_t bits = width(hi - lo);
+
+        for (int c = 0; c < SLOG_CHANNELS; c++) {
+            zz[c] = zigzag(sample->value[c] - last->value[c]);
+            if (zz[c] < zz_max[c]) zz[c] = zz_max[c];
+            bits += width(zz[c]);
+        }
+        if (pending_count < SLOG_BLOCK_MAX && pending_count * bits <= PAYLOAD_BITS) {
+            dt_min = lo;
+            dt_max = hi;
+            memcpy(zz_max, zz, sizeof(zz_max));
+        } else {
+            result = slog_flush(); // Starts a new block with this sample
+        }
+    }
+    if (pending_count == 0) {
+        dt_min = dt_max = 0;
+        memset(zz_max, 0, sizeof(zz_max));
+    }
+    pending[pending_count++] = *sample;
+    return result;
+}
+
+static uint32_t block_start(uint32_t seq) {
+    if (seq == next_seq) return pending_count ? pending[0].time_s : 0xFFFFFFFF;
+    return header(seq)->magic == SLOG_MAGIC ? header(seq)->t0 : 0; // Failed writes count as early
+}
+
+void slog_seek(SlogCursor *c, uint32_t time_s) {
+    uint32_t lo = first_seq, hi = next_seq;
+    SlogCursor next;
+    SlogSample s;
+
+    if (!pending_count && hi > lo) hi--; // No RAM block to land on
+    // Last block starting at or before time_s
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (block_start(mid) <= time_s) lo = mid; else hi = mid - 1;
+    }
+    memset(c, 0, sizeof(*c));
+    c->seq = lo;
+    for (next = *c; slog_read(&next, &s, 1) == 1 && s.time_s < time_s; ) *c = next;
+}
+
+int slog_read(SlogCursor *c, SlogSample *out, int max) {
+    int n = 0;
+
+    while (n < max && c->seq <= next_seq) {
+        const SlogHeader *h;
+
+        if (c->seq < first_seq) { // Reclaimed while the reader was away
+            c->seq = first_seq;
+            c->index = 0;
+        }
+        if (c->seq == next_seq) {
+            if (c->index >= pending_count) break;
+            c->prev = pending[c->index++];
+            out[n++] = c->prev;
+            continue;
+        }
+        h = header(c->seq);
+        if (c->verified != c->seq + 1) {
+            if (!block_ok(h, c->seq)) h = NULL;
+            c->verified = c->seq + 1;
+        }
+        if (!h || c->index >= h->count) {
+            c->seq++;
+            c->index = 0;
+            continue;
+        }
+        if (c->index == 0) {
+            c->prev.time_s = h->t0;
+            for (int ch = 0; ch < SLOG_CHANNELS; ch++) c->prev.value[ch] = h->v0[ch];
+        } else {
+            uint32_t pos = (c->index - 1) * sample_bits(h);
+            const uint8_t *bits = (const uint8_t *)(h + 1);
+            c->prev.time_s += h->dt_base + get_bits(bits, &pos, h->wt);
+            for (int ch = 0; ch < SLOG_CHANNELS; ch++) c->prev.value[ch] += unzigzag(get_bits(bits, &pos, h->wv[ch]));
+        }
+        c->index++;
+        out[n++] = c->prev;
+    }
+    return n;
+}
+
+uint32_t slog_blocks(void) {
+    return next_seq - first_seq;
+}
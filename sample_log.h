@@ -0,0 +1,56 @@
+#ifndef SAMPLE_LOG_H
+#define SAMPLE_LOG_H
+
+#include <stdint.h>
+
+// Compressed sample log in a ring of flash sectors. Samples collect in RAM
+// until they fill one 256-byte page, which is then written as a block: a
+// header with the first sample, followed by the time and value deltas of the
+// rest, bit-packed at the smallest width that fits the block (time deltas
+// relative to the shortest one, value deltas zigzag coded). Slowly changing
+// readings take about two bytes per sample instead of ten.
+//
+// Block n always lives in page n % pages, so the ring needs no separate
+// pointers: slog_init() reads one header per sector plus a binary search in
+// the newest one. Block headers carry their start time and form the sparse
+// time index; slog_seek() binary-searches them in place. When the writer
+// reaches a new sector it erases it, dropping that sector's oldest blocks.
+//
+// The flash is described by SlogFlash, so the same code runs on the on-chip
+// flash and on the simulated NOR device of the host benchmark. Not thread
+// safe, callers serialise access.
+
+#define SLOG_PAGE 256           // Block size, one flash page
+#define SLOG_CHANNELS 3
+#define SLOG_BLOCK_MAX 255      // Samples per block
+
+typedef struct {
+    uint32_t time_s;
+    uint16_t value[SLOG_CHANNELS];
+} SlogSample;
+
+typedef struct {
+    const uint8_t *mem;         // Memory-mapped start of the first sector
+    int sectors;                // At least 2
+    int sector_size;            // Bytes, a multiple of SLOG_PAGE
+    int (*erase)(int sector);   // 0 on success
+    int (*program)(int page, const void *data); // Writes one SLOG_PAGE page, 0 on success
+} SlogFlash;
+
+typedef struct {
+    uint32_t seq;               // Block being read, the RAM block when equal to the write position
+    int index;                  // Next sample in the block
+    uint32_t verified;          // seq + 1 once the block's CRC has been checked
+    SlogSample prev;            // Last sample read, zero before the first
+} SlogCursor;
+
+int slog_init(const SlogFlash *flash);          // Returns the number of blocks found
+int slog_append(const SlogSample *sample);     // 0, or -1 when a block could not be written
+int slog_flush(void);                           // Writes the RAM block out early
+int slog_flush_before(uint32_t time_s);         // Same, if its first sample is older than time_s
+void slog_seek(SlogCursor *c, uint32_t time_s); // To the first sample at or after time_s, so
+                                                // 0xFFFFFFFF leaves the newest one in c->prev
+int slog_read(SlogCursor *c, SlogSample *out, int max); // Samples copied, 0 at the end
+uint32_t slog_blocks(void);     // Blocks held in flash
+
+#endif